@@ -0,0 +1,725 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   btree.c
+ * @date   Fri Oct 16 16:05:00 2026
+ *
+ * @brief  cache-line "fat node" B-tree. A binary tree pays a cache miss per level; here every node
+ *         keeps its 15 keys (plus padding) in a single aligned cache line and is searched with a
+ *         vector compare and a movemask (AVX2 or SSE2, plain C otherwise), so a lookup touches
+ *         about a quarter of the lines an rbSearch() does. Insertion splits full nodes and deletion
+ *         refills minimal nodes on the way down, so neither ever walks back up. Not thread safe.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "xalloc.h"
+#include "btree.h"
+
+/* traversal cursor: path from the root, top entry is the current key */
+typedef struct {
+    BtNode *nodes[BT_MAXDEPTH];
+    uint32_t pos[BT_MAXDEPTH]; /* key index at the top, child index we went down into below it */
+    int depth;
+} BtCursor;
+
+/* verification stack entry: node, exclusive key bounds (-1 / 2^32 = none) and depth */
+typedef struct {
+    BtNode *node;
+    int64_t low;
+    int64_t high;
+    uint32_t depth;
+} BtVerifyItem;
+
+/*
+ * number of keys in node lower than key, which is also the index of the first key >= key, or the child to go down into.
+ * Vector compares are signed, so both sides get their sign bit flipped to compare unsigned; padding is UINT32_MAX and never counts
+ */
+static inline uint32_t btRank(const BtNode *node, const uint32_t key) {
+
+#if defined(__AVX2__)
+    const __m256i bias = _mm256_set1_epi32(INT32_MIN);
+    const __m256i k = _mm256_xor_si256(_mm256_set1_epi32((int32_t)key), bias);
+    const __m256i lo = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)node->keys), bias);
+    const __m256i hi = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(node->keys + 8)), bias);
+    uint32_t mask = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, lo)))
+		| ((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, hi))) << 8);
+
+    return __builtin_popcount(mask);
+#elif defined(__SSE2__)
+    const __m128i bias = _mm_set1_epi32(INT32_MIN);
+    const __m128i k = _mm_xor_si128(_mm_set1_epi32((int32_t)key), bias);
+    const __m128i *keys = (const __m128i*)node->keys;
+    __m128i c0 = _mm_cmpgt_epi32(k, _mm_xor_si128(_mm_load_si128(keys), bias));
+    __m128i c1 = _mm_cmpgt_epi32(k, _mm_xor_si128(_mm_load_si128(keys + 1), bias));
+    __m128i c2 = _mm_cmpgt_epi32(k, _mm_xor_si128(_mm_load_si128(keys + 2), bias));
+    __m128i c3 = _mm_cmpgt_epi32(k, _mm_xor_si128(_mm_load_si128(keys + 3), bias));
+    /* narrow 16 x 32-bit masks down to 16 bytes, one bit each */
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(_mm_packs_epi32(c0, c1), _mm_packs_epi32(c2, c3)));
+
+    return __builtin_popcount(mask);
+#else
+    uint32_t i, ret = 0;
+
+    for(i = 0; i < BT_ORDER; i++) {
+	ret += (node->keys[i] < key);
+    }
+
+    return ret;
+#endif
+
+}
+
+/* get a new empty node */
+static inline BtNode* btCreateNode(BtTree *tree, const bool leaf) {
+
+    BtNode *ret = mpAlloc(tree->pool);
+
+    memset(ret->keys, 0xff, sizeof(ret->keys));
+    ret->count = 0;
+    ret->leaf = leaf;
+
+    return ret;
+
+}
+
+/* is key at index i of node */
+static inline bool btHasKey(const BtNode *node, const uint32_t i, const uint32_t key) {
+
+    /* padding is UINT32_MAX, which is also a valid key, hence the count check */
+    return i < node->count && node->keys[i] == key;
+
+}
+
+/* split a full child at index i of a non-full node: the median key moves up, the upper half moves to a new node */
+static inline void btSplitChild(BtTree *tree, BtNode *parent, const uint32_t i) {
+
+    BtNode *left = parent->children[i];
+    BtNode *right = btCreateNode(tree, left->leaf);
+    const uint32_t mid = BT_MAXKEYS / 2;
+
+    right->count = BT_MAXKEYS - mid - 1;
+    memcpy(right->keys, left->keys + mid + 1, right->count * sizeof(uint32_t));
+    memcpy(right->values, left->values + mid + 1, right->count * sizeof(void*));
+    if(!left->leaf) {
+	memcpy(right->children, left->children + mid + 1, (right->count + 1) * sizeof(BtNode*));
+    }
+
+    /* make room in the parent */
+    memmove(parent->keys + i + 1, parent->keys + i, (parent->count - i) * sizeof(uint32_t));
+    memmove(parent->values + i + 1, parent->values + i, (parent->count - i) * sizeof(void*));
+    memmove(parent->children + i + 2, parent->children + i + 1, (parent->count - i) * sizeof(BtNode*));
+    parent->keys[i] = left->keys[mid];
+    parent->values[i] = left->values[mid];
+    parent->children[i + 1] = right;
+    parent->count++;
+
+    /* re-pad what is left */
+    memset(left->keys + mid, 0xff, (BT_MAXKEYS - mid) * sizeof(uint32_t));
+    left->count = mid;
+
+}
+
+/* merge child i + 1 and the key between them into child i, return the merged child */
+static inline BtNode* btMerge(BtTree *tree, BtNode *parent, const uint32_t i) {
+
+    BtNode *left = parent->children[i];
+    BtNode *right = parent->children[i + 1];
+
+    left->keys[left->count] = parent->keys[i];
+    left->values[left->count] = parent->values[i];
+    memcpy(left->keys + left->count + 1, right->keys, right->count * sizeof(uint32_t));
+    memcpy(left->values + left->count + 1, right->values, right->count * sizeof(void*));
+    if(!left->leaf) {
+	memcpy(left->children + left->count + 1, right->children, (right->count + 1) * sizeof(BtNode*));
+    }
+    left->count += right->count + 1;
+
+    /* close the gap in the parent */
+    memmove(parent->keys + i, parent->keys + i + 1, (parent->count - i - 1) * sizeof(uint32_t));
+    memmove(parent->values + i, parent->values + i + 1, (parent->count - i - 1) * sizeof(void*));
+    memmove(parent->children + i + 1, parent->children + i + 2, (parent->count - i - 1) * sizeof(BtNode*));
+    parent->count--;
+    parent->keys[parent->count] = UINT32_MAX;
+
+    mpRelease(tree->pool, right);
+
+    /* the root ran out of keys: the tree shrinks at the top */
+    if(parent == tree->root && parent->count == 0) {
+	tree->root = left;
+	tree->height--;
+	mpRelease(tree->pool, parent);
+    }
+
+    return left;
+
+}
+
+/* move the last key of child i - 1 up into the parent, and the parent's key down into child i */
+static inline void btBorrowLeft(BtNode *parent, const uint32_t i) {
+
+    BtNode *child = parent->children[i];
+    BtNode *sibling = parent->children[i - 1];
+
+    memmove(child->keys + 1, child->keys, child->count * sizeof(uint32_t));
+    memmove(child->values + 1, child->values, child->count * sizeof(void*));
+    if(!child->leaf) {
+	memmove(child->children + 1, child->children, (child->count + 1) * sizeof(BtNode*));
+	child->children[0] = sibling->children[sibling->count];
+    }
+    child->keys[0] = parent->keys[i - 1];
+    child->values[0] = parent->values[i - 1];
+    child->count++;
+
+    sibling->count--;
+    parent->keys[i - 1] = sibling->keys[sibling->count];
+    parent->values[i - 1] = sibling->values[sibling->count];
+    sibling->keys[sibling->count] = UINT32_MAX;
+
+}
+
+/* move the first key of child i + 1 up into the parent, and the parent's key down into child i */
+static inline void btBorrowRight(BtNode *parent, const uint32_t i) {
+
+    BtNode *child = parent->children[i];
+    BtNode *sibling = parent->children[i + 1];
+
+    child->keys[child->count] = parent->keys[i];
+    child->values[child->count] = parent->values[i];
+    if(!child->leaf) {
+	child->children[child->count + 1] = sibling->children[0];
+	memmove(sibling->children, sibling->children + 1, sibling->count * sizeof(BtNode*));
+    }
+    child->count++;
+
+    parent->keys[i] = sibling->keys[0];
+    parent->values[i] = sibling->values[0];
+
+    sibling->count--;
+    memmove(sibling->keys, sibling->keys + 1, sibling->count * sizeof(uint32_t));
+    memmove(sibling->values, sibling->values + 1, sibling->count * sizeof(void*));
+    sibling->keys[sibling->count] = UINT32_MAX;
+
+}
+
+/* push a node onto the cursor path */
+static inline void btCursorPush(BtCursor *cursor, BtNode *node, const uint32_t pos) {
+
+    cursor->nodes[cursor->depth] = node;
+    cursor->pos[cursor->depth] = pos;
+    cursor->depth++;
+
+}
+
+/* go down from node to its first (RB_ASC) or last (RB_DESC) key */
+static inline void btCursorDown(BtCursor *cursor, BtNode *node, const int dir) {
+
+    while(!node->leaf) {
+	uint32_t pos = (dir == RB_ASC) ? 0 : node->count;
+	btCursorPush(cursor, node, pos);
+	node = node->children[pos];
+    }
+
+    btCursorPush(cursor, node, (dir == RB_ASC) ? 0 : node->count - 1);
+
+}
+
+/* drop the current (exhausted) entry and go up to the next key in given direction, false if there is none */
+static inline bool btCursorUp(BtCursor *cursor, const int dir) {
+
+    cursor->depth--;
+
+    while(cursor->depth > 0) {
+
+	BtNode *node = cursor->nodes[cursor->depth - 1];
+	uint32_t pos = cursor->pos[cursor->depth - 1];
+
+	/* we came up from child pos: the next key up is key pos, the previous one is key pos - 1 */
+	if(dir == RB_ASC && pos < node->count) {
+	    return true;
+	}
+	if(dir == RB_DESC && pos > 0) {
+	    cursor->pos[cursor->depth - 1] = pos - 1;
+	    return true;
+	}
+
+	cursor->depth--;
+
+    }
+
+    return false;
+
+}
+
+/* move to the next key in given direction, false if there is none */
+static inline bool btCursorNext(BtCursor *cursor, const int dir) {
+
+    BtNode *node = cursor->nodes[cursor->depth - 1];
+    uint32_t pos = cursor->pos[cursor->depth - 1];
+
+    /* inner node: the next key is the first (or last) one in the subtree right (or left) of the current key */
+    if(!node->leaf) {
+	pos += (dir == RB_ASC);
+	cursor->pos[cursor->depth - 1] = pos;
+	btCursorDown(cursor, node->children[pos], dir);
+	return true;
+    }
+
+    if(dir == RB_ASC && pos + 1 < node->count) {
+	cursor->pos[cursor->depth - 1] = pos + 1;
+	return true;
+    }
+
+    if(dir == RB_DESC && pos > 0) {
+	cursor->pos[cursor->depth - 1] = pos - 1;
+	return true;
+    }
+
+    return btCursorUp(cursor, dir);
+
+}
+
+/* position the cursor at the first key >= key (RB_ASC) or the last key <= key (RB_DESC), false if there is none */
+static inline bool btCursorSeek(BtTree *tree, BtCursor *cursor, const uint32_t key, const int dir) {
+
+    BtNode *node = tree->root;
+
+    cursor->depth = 0;
+
+    while(node != NULL) {
+
+	uint32_t i = btRank(node, key);
+
+	if(btHasKey(node, i, key)) {
+	    btCursorPush(cursor, node, i);
+	    return true;
+	}
+
+	if(node->leaf) {
+	    if(dir == RB_ASC) {
+		btCursorPush(cursor, node, i);
+		return (i < node->count) ? true : btCursorUp(cursor, dir);
+	    }
+	    btCursorPush(cursor, node, (i > 0) ? i - 1 : 0);
+	    return (i > 0) ? true : btCursorUp(cursor, dir);
+	}
+
+	btCursorPush(cursor, node, i);
+	node = node->children[i];
+
+    }
+
+    return false;
+
+}
+
+/* create a B-tree */
+BtTree* btCreate() {
+
+    BtTree *ret;
+
+    xcalloc(ret, 1, sizeof(BtTree));
+    ret->pool = mpCreate(sizeof(BtNode), 0, MP_ALIGN_LINE);
+
+    return ret;
+
+}
+
+/* search for key, return its value slot */
+void** btSearch(BtTree *tree, const uint32_t key) {
+
+    BtNode *node = tree->root;
+
+    while(node != NULL) {
+
+	uint32_t i = btRank(node, key);
+
+	if(btHasKey(node, i, key)) {
+	    return &node->values[i];
+	}
+
+	node = node->leaf ? NULL : node->children[i];
+
+    }
+
+    return NULL;
+
+}
+
+/* insert key, splitting full nodes on the way down, return the value slot */
+void** btInsert(BtTree *tree, const uint32_t key) {
+
+    BtNode *node;
+
+    if(tree->root == NULL) {
+	tree->root = btCreateNode(tree, true);
+	tree->height = 1;
+    }
+
+    /* full root: split it under a new root, the tree grows at the top */
+    if(tree->root->count == BT_MAXKEYS) {
+	node = btCreateNode(tree, false);
+	node->children[0] = tree->root;
+	tree->root = node;
+	tree->height++;
+	btSplitChild(tree, node, 0);
+    }
+
+    node = tree->root;
+
+    while(true) {
+
+	uint32_t i = btRank(node, key);
+
+	if(btHasKey(node, i, key)) {
+	    return &node->values[i];
+	}
+
+	if(node->leaf) {
+	    memmove(node->keys + i + 1, node->keys + i, (node->count - i) * sizeof(uint32_t));
+	    memmove(node->values + i + 1, node->values + i, (node->count - i) * sizeof(void*));
+	    node->keys[i] = key;
+	    node->values[i] = NULL;
+	    node->count++;
+	    tree->count++;
+	    return &node->values[i];
+	}
+
+	/* split a full child before going down, so that there is always room for a key coming up */
+	if(node->children[i]->count == BT_MAXKEYS) {
+	    btSplitChild(tree, node, i);
+	    if(node->keys[i] == key) {
+		return &node->values[i];
+	    }
+	    i += (key > node->keys[i]);
+	}
+
+	node = node->children[i];
+
+    }
+
+}
+
+/* delete key, making sure every node we go down into can spare a key */
+bool btDeleteKey(BtTree *tree, const uint32_t key) {
+
+    BtNode *node = tree->root;
+    uint32_t target = key;
+
+    while(node != NULL) {
+
+	uint32_t i = btRank(node, target);
+	bool found = btHasKey(node, i, target);
+
+	if(node->leaf) {
+
+	    if(!found) {
+		return false;
+	    }
+
+	    node->count--;
+	    memmove(node->keys + i, node->keys + i + 1, (node->count - i) * sizeof(uint32_t));
+	    memmove(node->values + i, node->values + i + 1, (node->count - i) * sizeof(void*));
+	    node->keys[node->count] = UINT32_MAX;
+	    tree->count--;
+
+	    if(node == tree->root && node->count == 0) {
+		mpRelease(tree->pool, node);
+		tree->root = NULL;
+		tree->height = 0;
+	    }
+
+	    return true;
+
+	}
+
+	if(found) {
+
+	    BtNode *left = node->children[i];
+	    BtNode *right = node->children[i + 1];
+
+	    if(left->count > BT_MINKEYS) {
+		/* replace with the predecessor and go delete that instead */
+		BtNode *pred = left;
+		while(!pred->leaf) {
+		    pred = pred->children[pred->count];
+		}
+		target = node->keys[i] = pred->keys[pred->count - 1];
+		node->values[i] = pred->values[pred->count - 1];
+		node = left;
+	    } else if(right->count > BT_MINKEYS) {
+		/* same with the successor */
+		BtNode *succ = right;
+		while(!succ->leaf) {
+		    succ = succ->children[0];
+		}
+		target = node->keys[i] = succ->keys[0];
+		node->values[i] = succ->values[0];
+		node = right;
+	    } else {
+		/* both minimal: merge them around the key and go delete it from there */
+		node = btMerge(tree, node, i);
+	    }
+
+	    continue;
+
+	}
+
+	/* the child we go down into must be able to lose a key: borrow from a sibling, or merge with one */
+	if(node->children[i]->count == BT_MINKEYS) {
+	    if(i > 0 && node->children[i - 1]->count > BT_MINKEYS) {
+		btBorrowLeft(node, i);
+	    } else if(i < node->count && node->children[i + 1]->count > BT_MINKEYS) {
+		btBorrowRight(node, i);
+	    } else if(i < node->count) {
+		node = btMerge(tree, node, i);
+		continue;
+	    } else {
+		node = btMerge(tree, node, i - 1);
+		continue;
+	    }
+	}
+
+	node = node->children[i];
+
+    }
+
+    return false;
+
+}
+
+/* in-order traversal */
+void btInOrder(BtTree *tree, BtCallback callback, void *user, const int dir) {
+
+    btInOrderRange(tree, callback, user, dir, 0, RB_INF, 0, RB_INF);
+
+}
+
+/* in-order range traversal */
+uint32_t btInOrderRange(BtTree *tree, BtCallback callback, void *user, const int dir,
+			const uint32_t low, const int lowqual, const uint32_t high, const int highqual) {
+
+    BtCursor cursor;
+    uint32_t nodenumber = 0;
+    bool cont = true;
+    bool more;
+    /* start and end limits, swapped for descending order */
+    uint32_t from = (dir == RB_ASC) ? low : high;
+    uint32_t to = (dir == RB_ASC) ? high : low;
+    int fromqual = (dir == RB_ASC) ? lowqual : highqual;
+    int toqual = (dir == RB_ASC) ? highqual : lowqual;
+
+    if(tree == NULL || tree->root == NULL) {
+	return 0;
+    }
+
+    if(fromqual == RB_INF) {
+	cursor.depth = 0;
+	btCursorDown(&cursor, tree->root, dir);
+	more = true;
+    } else {
+	more = btCursorSeek(tree, &cursor, from, dir);
+	if(more && fromqual == RB_EXCL && cursor.nodes[cursor.depth - 1]->keys[cursor.pos[cursor.depth - 1]] == from) {
+	    more = btCursorNext(&cursor, dir);
+	}
+    }
+
+    while(cont && more) {
+
+	BtNode *node = cursor.nodes[cursor.depth - 1];
+	uint32_t pos = cursor.pos[cursor.depth - 1];
+	uint32_t key = node->keys[pos];
+
+	if(toqual != RB_INF) {
+	    if((dir == RB_ASC) ? (key > to) : (key < to)) {
+		break;
+	    }
+	    if(toqual == RB_EXCL && key == to) {
+		break;
+	    }
+	}
+
+	if(callback != NULL) {
+	    callback(tree, key, &node->values[pos], user, &cont, nodenumber);
+	}
+	nodenumber++;
+
+	more = btCursorNext(&cursor, dir);
+
+    }
+
+    return nodenumber;
+
+}
+
+/* basic callback to print entry information */
+void btDumpCallback(BtTree *tree, const uint32_t key, void **value, void *user, bool *cont, const uint32_t nodenumber) {
+
+    printf("key %u, value %p, entry %u\n", key, *value, nodenumber);
+
+}
+
+/* empty callback for traversal tests */
+void btDummyCallback(BtTree *tree, const uint32_t key, void **value, void *user, bool *cont, const uint32_t nodenumber) {
+
+}
+
+/* verify B-tree invariants */
+bool btVerify(BtTree *tree, bool chatty) {
+
+    BtVerifyItem stack[BT_MAXDEPTH * BT_ORDER];
+    int sh = 0;
+    uint32_t count = 0, nodes = 0;
+    bool valid = true;
+
+    if(tree == NULL || tree->root == NULL) {
+	if(tree != NULL && tree->count != 0) {
+	    valid = false;
+	    if(chatty) {
+		fprintf(stderr, "Count violation: empty tree, count %d\n", tree->count);
+	    }
+	} else if(chatty) {
+	    fprintf(stderr, "Empty tree, valid\n");
+	}
+	return valid;
+    }
+
+    stack[sh++] = (BtVerifyItem) { tree->root, -1, (int64_t)UINT32_MAX + 1, 1 };
+
+    while(sh > 0 && valid) {
+
+	BtVerifyItem item = stack[--sh];
+	BtNode *node = item.node;
+	uint32_t i;
+
+	nodes++;
+	count += node->count;
+
+	if(node->count > BT_MAXKEYS || node->count < ((node == tree->root) ? 1 : BT_MINKEYS)) {
+	    valid = false;
+	    if(chatty) {
+		fprintf(stderr, "Fill violation: node with first key %u holds %d keys\n", node->keys[0], node->count);
+	    }
+	    break;
+	}
+
+	for(i = 0; i < BT_ORDER; i++) {
+	    if(i < node->count) {
+		if(node->keys[i] <= item.low || node->keys[i] >= item.high || (i > 0 && node->keys[i] <= node->keys[i - 1])) {
+		    valid = false;
+		    if(chatty) {
+			fprintf(stderr, "Order violation: key %u at index %d\n", node->keys[i], i);
+		    }
+		}
+	    } else if(node->keys[i] != UINT32_MAX) {
+		valid = false;
+		if(chatty) {
+		    fprintf(stderr, "Padding violation: key %u at index %d, node key count %d\n", node->keys[i], i, node->count);
+		}
+	    }
+	}
+
+	if(node->leaf) {
+	    if(item.depth != tree->height) {
+		valid = false;
+		if(chatty) {
+		    fprintf(stderr, "Depth violation: leaf with first key %u at depth %d, tree height %d\n", node->keys[0], item.depth, tree->height);
+		}
+	    }
+	    continue;
+	}
+
+	if(item.depth >= BT_MAXDEPTH) {
+	    valid = false;
+	    if(chatty) {
+		fprintf(stderr, "Depth violation: inner node with first key %u at depth %d\n", node->keys[0], item.depth);
+	    }
+	    break;
+	}
+
+	for(i = 0; i <= node->count; i++) {
+	    stack[sh++] = (BtVerifyItem) {
+		node->children[i],
+		(i == 0) ? item.low : node->keys[i - 1],
+		(i == node->count) ? item.high : node->keys[i],
+		item.depth + 1
+	    };
+	}
+
+    }
+
+    if(valid && count != tree->count) {
+	valid = false;
+	if(chatty) {
+	    fprintf(stderr, "Count violation: %d keys found, tree count %d\n", count, tree->count);
+	}
+    }
+
+    if(chatty) {
+
+	if(valid) {
+	    fprintf(stderr, "Valid B-tree, key count %d, node count %d, height %d\n", tree->count, nodes, tree->height);
+	} else {
+	    fprintf(stderr, "Invalid B-tree.\n");
+	}
+
+    }
+
+    return valid;
+
+}
+
+/* empty the tree and free it */
+void btFree(BtTree *tree) {
+
+    if(tree != NULL) {
+	mpFree(tree->pool);
+	free(tree);
+    }
+
+}
+
+/* just empty the tree: all nodes come from the tree's pool */
+void btEmpty(BtTree *tree) {
+
+    if(tree != NULL) {
+	mpReset(tree->pool);
+	tree->root = NULL;
+	tree->count = 0;
+	tree->height = 0;
+    }
+
+}
@@ -0,0 +1,119 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   btree.h
+ * @date   Fri Oct 16 16:05:00 2026
+ *
+ * @brief  cache-line "fat node" B-tree type and function declarations: an alternative engine
+ *         with the same operations as rbt.h, holding up to 15 keys per node in one cache line
+ *
+ */
+
+#ifndef BTREE_H_
+#define BTREE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* shared constants: RB_ASC, RB_INCL, RB_CHATTY and friends, and the pool */
+#include "rbt.h"
+
+/* node fan-out: 16 children and 15 keys, a non-root node holds at least 7 keys */
+#define BT_ORDER 16
+#define BT_MAXKEYS (BT_ORDER - 1)
+#define BT_MINKEYS (BT_ORDER / 2 - 1)
+
+/* maximum tree depth: with at least 8 children per inner node, 2^32 keys fit in 11 levels */
+#define BT_MAXDEPTH 12
+
+typedef struct BtNode BtNode;
+
+/*
+ * the tree node. Keys come first and take exactly one cache line: unused key slots (always
+ * including the last one) hold UINT32_MAX, so that a node can be searched as 16 keys at once
+ */
+struct BtNode {
+    uint32_t keys[BT_ORDER];
+    void* values[BT_MAXKEYS];
+    uint32_t count;
+    bool leaf;
+    BtNode* children[BT_ORDER];
+};
+
+/* tree container */
+typedef struct {
+    BtNode *root;
+    MPool *pool; /* node pool, cache line aligned */
+    uint32_t count;
+    uint32_t height;
+} BtTree;
+
+/*
+ * callback typedef, the B-tree counterpart of RbCallback: tree, key, pointer to the value slot,
+ * user data pointer, pointer to bool (set to false to stop traversal), entry count so far
+ */
+typedef void (*BtCallback) (BtTree*, const uint32_t, void**, void*, bool*, const uint32_t);
+
+/* create an empty B-tree */
+BtTree*		btCreate();
+
+/* search for key, return pointer to its value slot or NULL if not found */
+void**		btSearch(BtTree *tree, const uint32_t key);
+
+/*
+ * insert key into tree, return pointer to its value slot: NULL for a new key, existing value otherwise.
+ * slots move as the tree changes, so a slot pointer is only valid until the next insertion or deletion
+ */
+void**		btInsert(BtTree *tree, const uint32_t key);
+
+/* delete key from tree, return false if not found */
+bool		btDeleteKey(BtTree *tree, const uint32_t key);
+
+/* in-order traversal, dir = RB_ASC | RB_DESC, running specified callback function on each entry */
+void		btInOrder(BtTree *tree, BtCallback callback, void *user, const int dir);
+/* range traversal with the same range qualifiers as rbInOrderRange(), returns the number of entries within range */
+uint32_t	btInOrderRange(BtTree *tree, BtCallback callback, void *user, const int dir,
+			const uint32_t low, const int lowqual, const uint32_t high, const int highqual);
+
+/* basic callback to print entry information */
+void		btDumpCallback(BtTree *tree, const uint32_t key, void **value, void *user, bool *cont, const uint32_t nodenumber);
+
+/* empty callback for traversal tests */
+void		btDummyCallback(BtTree *tree, const uint32_t key, void **value, void *user, bool *cont, const uint32_t nodenumber);
+
+/* verify B-tree invariants: key order, node fill, padding, leaf depth and count, optionally displaying status on stderr */
+bool		btVerify(BtTree *tree, bool chatty);
+
+/* free tree nodes and tree */
+void		btFree(BtTree *tree);
+
+/* just free nodes */
+void		btEmpty(BtTree *tree);
+
+#endif /* BTREE_H_ */
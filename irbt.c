@@ -0,0 +1,1061 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   irbt.c
+ * @date   Fri Oct 16 14:02:00 2026
+ *
+ * @brief  index-linked red-black tree implementation, a port of rbt.c where nodes live in a single
+ *         growable array and links are 32-bit indices. Halves the link footprint, and the tree
+ *         can be copied or moved as a single block. Not thread safe.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "fq.h"
+#include "st_inline.h"
+#include "xalloc.h"
+
+#include "irbt.h"
+
+#define IRB_MIN_CAPACITY 16
+
+/* helper macros - slot 0 is a permanently black leaf, so no NULL checks needed for colour */
+#define irbRed(tree, index) irbGetRed(irbNode(tree, index))
+#define irbBlack(tree, index) (!irbGetRed(irbNode(tree, index)))
+#define irbDir(tree, index) (index == irbNode(tree, irbGetParent(irbNode(tree, index)))->children[RB_RIGHT])
+#define irbCname(node) (irbGetRed(node) ? "red" : "black")
+
+/* red-black tree verification state container */
+typedef struct {
+    int maxbh;
+    int maxheight;
+    bool valid;
+    bool chatty;
+    bool stop;
+} IrbVerifyState;
+
+/* helper structure to assist with height / black height tracking during traversal */
+typedef struct {
+    int height;
+    int bh;
+    uint32_t node;
+} IrbNodeInfo;
+
+/* resize node store to given number of slots */
+static inline void irbResize(IrbTree *tree, const uint32_t capacity) {
+
+    xrealloc(tree->nodes, tree->nodes, (size_t)capacity * sizeof(IrbNode));
+    tree->capacity = capacity;
+
+}
+
+/* get a free slot: deleted slots first, then unused ones, growing the store if need be */
+static inline uint32_t irbAllocNode(IrbTree *tree) {
+
+    uint32_t ret = tree->freelist;
+
+    if(ret != IRB_NIL) {
+	tree->freelist = tree->nodes[ret].children[RB_LEFT];
+	return ret;
+    }
+
+    if(tree->used == tree->capacity) {
+
+	if(tree->capacity > IRB_MAXNODES) {
+	    return IRB_NIL;
+	}
+
+	irbResize(tree, (tree->capacity > (IRB_MAXNODES >> 1)) ? IRB_MAXNODES + 1 : tree->capacity << 1);
+
+    }
+
+    return tree->used++;
+
+}
+
+/* free node value, if we own it */
+static inline void irbFreeValue(IrbTree *tree, IrbNode *node) {
+#ifndef RBT_SET
+    if(tree->freeCallback != NULL) {
+	tree->freeCallback(node->value);
+    }
+
+    if(tree->flags & RB_PREALLOC) {
+	free(node->value);
+    }
+#endif /* RBT_SET */
+}
+
+/* put the slot on the freelist, freeing node value first if asked to */
+static inline void irbReleaseNode(IrbTree *tree, const uint32_t index, const bool freevalue) {
+
+    IrbNode *node = irbNode(tree, index);
+
+    if(freevalue) {
+	irbFreeValue(tree, node);
+    }
+    node->children[RB_LEFT] = tree->freelist;
+    tree->freelist = index;
+
+}
+
+/* binary search tree insertion, return index of newly added node - or existing node if found */
+static inline uint32_t bstInsert(IrbTree *tree, const uint32_t key) {
+
+    uint32_t current = tree->root;
+    uint32_t parent = IRB_NIL;
+    IrbNode *node;
+    int dir = 0;
+
+    /* find the parent to attach new node, return if already exists */
+    while(current != IRB_NIL) {
+
+	node = irbNode(tree, current);
+
+	if(node->key == key) {
+	    return current;
+	}
+
+	parent = current;
+	dir = ( key > node->key );
+	current = node->children[dir];
+
+    }
+
+    /* create a new node, it is born red */
+    if((current = irbAllocNode(tree)) == IRB_NIL) {
+	return IRB_NIL;
+    }
+
+    node = irbNode(tree, current);
+    node->children[RB_LEFT] = node->children[RB_RIGHT] = IRB_NIL;
+    node->parent = parent | IRB_RED;
+    node->key = key;
+#ifndef RBT_SET
+    node->value = NULL;
+    if(tree->flags & RB_PREALLOC) {
+	xcalloc(node->value, 1, tree->valuesize);
+    }
+#endif /* RBT_SET */
+
+    tree->count++;
+
+    /* link parent with new node */
+    if(parent != IRB_NIL) {
+	irbNode(tree, parent)->children[dir] = current;
+    }
+
+    return current;
+
+}
+
+/* perform a rotation of the given node in given direction */
+static inline void irbRotate(IrbTree *tree, const uint32_t root, const int dir) {
+
+    IrbNode *rnode = irbNode(tree, root);
+    /* pivot node */
+    uint32_t pivot = rnode->children[!dir];
+    IrbNode *pnode = irbNode(tree, pivot);
+    uint32_t parent = irbGetParent(rnode);
+
+    /* swapsies */
+    rnode->children[!dir] = pnode->children[dir];
+    if(pnode->children[dir] != IRB_NIL) {
+	irbSetParent(irbNode(tree, pnode->children[dir]), root);
+    }
+    pnode->children[dir] = root;
+    irbSetParent(pnode, parent);
+    irbSetParent(rnode, pivot);
+
+    /* link parent to pivot, or update tree root if pivot is the new root */
+    if(parent == IRB_NIL) {
+	tree->root = pivot;
+    } else {
+	IrbNode *pp = irbNode(tree, parent);
+	pp->children[pp->children[RB_RIGHT] == root] = pivot;
+    }
+
+}
+
+/* callback freeing a node's value only, the store is reset afterwards */
+static IrbNode* irbFreeValueCallback(IrbTree *tree, IrbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber) {
+
+    irbFreeValue(tree, node);
+
+    return node;
+}
+
+/* callback duplicating preallocated values in a copied tree */
+static IrbNode* irbCopyValueCallback(IrbTree *tree, IrbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber) {
+#ifndef RBT_SET
+    void *value;
+
+    xmalloc(value, tree->valuesize);
+    memcpy(value, node->value, tree->valuesize);
+    node->value = value;
+#endif /* RBT_SET */
+    return node;
+}
+
+/* callback used for tree verification */
+static IrbNode* irbVerifyCallback(IrbTree *tree, IrbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber) {
+
+    IrbVerifyState *state = user;
+
+    if(node != NULL) {
+
+	if(height > state->maxheight) {
+	    state->maxheight = height;
+	}
+
+	/* check black height of node with zero or one child */
+	if(node->children[RB_LEFT] == IRB_NIL || node->children[RB_RIGHT] == IRB_NIL) {
+
+	    if(state->maxbh == 0) {
+		state->maxbh = bh;
+	    }
+
+	    /* if we see any changes in black height, tree is invalid */
+	    if(bh != state->maxbh) {
+		state->valid = false;
+		if(state->chatty) {
+		    fprintf(stderr, "Black height violation: key %d black height %d != previous black height seen %d\n", node->key, bh, state->maxbh);
+		}
+		if(state->stop) {
+		    *cont = false;
+		    return node;
+		}
+		state->maxbh = bh;
+	    }
+
+	}
+
+	if(irbGetRed(node) && irbRed(tree, irbGetParent(node))) {
+	    state->valid = false;
+	    if(state->chatty) {
+		fprintf(stderr, "Red-red violation: key %d red -> parent key %d red\n", node->key, irbNode(tree, irbGetParent(node))->key);
+	    }
+	    if(state->stop) {
+		    *cont = false;
+	    }
+	}
+
+    }
+
+    return node;
+
+}
+
+/* create a tree */
+IrbTree* irbCreate() {
+
+    IrbTree *ret;
+
+    xcalloc(ret, 1, sizeof(IrbTree));
+    xcalloc(ret->nodes, IRB_MIN_CAPACITY, sizeof(IrbNode));
+    ret->capacity = IRB_MIN_CAPACITY;
+    ret->used = 1;
+
+    return ret;
+
+}
+
+/* create a tree that will pre-allocate values of given size on insertion */
+IrbTree* irbCreatePrealloc(const size_t valuesize, void (*freeCallback) (void *value)) {
+
+#ifdef RBT_SET
+    return NULL;
+#else
+    IrbTree *ret = irbCreate();
+
+    if(ret != NULL) {
+	ret->freeCallback = freeCallback;
+	ret->valuesize = valuesize;
+	ret->flags |= RB_PREALLOC;
+    }
+
+    return ret;
+#endif /* RBT_SET */
+}
+
+/* grow the store to hold at least count nodes */
+void irbReserve(IrbTree *tree, const uint32_t count) {
+
+    uint32_t capacity = (count > IRB_MAXNODES) ? IRB_MAXNODES + 1 : count + 1;
+
+    if(capacity > tree->capacity) {
+	irbResize(tree, capacity);
+    }
+
+}
+
+/* copy the tree: one block copy of the store, plus values if we own them */
+IrbTree* irbCopy(IrbTree *tree) {
+
+    IrbTree *ret;
+
+    xmalloc(ret, sizeof(IrbTree));
+    memcpy(ret, tree, sizeof(IrbTree));
+    xmalloc(ret->nodes, (size_t)tree->capacity * sizeof(IrbNode));
+    memcpy(ret->nodes, tree->nodes, (size_t)tree->used * sizeof(IrbNode));
+
+    if(tree->flags & RB_PREALLOC) {
+	irbInOrder(ret, irbCopyValueCallback, NULL, RB_ASC);
+    }
+
+    return ret;
+
+}
+
+/* binary search tree search (in a red-black tree) */
+IrbNode* irbSearch(IrbTree *tree, const uint32_t key) {
+
+    IrbNode *nodes = tree->nodes;
+    uint32_t current = tree->root;
+
+    while(current != IRB_NIL) {
+
+	if(nodes[current].key == key) {
+	    return nodes + current;
+	}
+
+	current = nodes[current].children[key > nodes[current].key];
+
+    }
+
+    return NULL;
+}
+
+/* insert a key into the tree, return the newly inserted node, or existing node if key exists */
+IrbNode* irbInsert(IrbTree *tree, const uint32_t key) {
+
+    /* the new node is coloured red only on creation - if exists, no change of colour, so no violations */
+    uint32_t ret = bstInsert(tree, key);
+    uint32_t current = ret;
+
+    if(ret == IRB_NIL) {
+	return NULL;
+    }
+
+    /* empty tree, new root */
+    if(tree->root == IRB_NIL) {
+	tree->root = ret;
+	irbSetRed(irbNode(tree, ret), false);
+	return irbNode(tree, ret);
+    }
+
+    /* travel upwards and correct red->red violations */
+    while(irbRed(tree, current) && irbRed(tree, irbGetParent(irbNode(tree, current)))) {
+
+	uint32_t parent = irbGetParent(irbNode(tree, current));
+	uint32_t grandparent = irbGetParent(irbNode(tree, parent));
+
+	/* parent's direction */
+	int dir = irbDir(tree, parent);
+	int otherdir = !dir;
+
+	/* knowing the parent's direction, uncle is the other guy */
+	uint32_t uncle = irbNode(tree, grandparent)->children[otherdir];
+
+	/* red uncle: recolour, move up */
+	if(irbRed(tree, uncle)) {
+	    irbSetRed(irbNode(tree, grandparent), true);
+	    irbSetRed(irbNode(tree, parent), false);
+	    irbSetRed(irbNode(tree, uncle), false);
+	    current = grandparent;
+	/* black uncle - rotate and recolour */
+	} else {
+	    /* current is in the opposite direction to parent - there will be two rotations */
+	    if(current == irbNode(tree, parent)->children[otherdir]) {
+		    irbRotate(tree, parent, dir);
+		    current = parent;
+		    parent = irbGetParent(irbNode(tree, current));
+	    }
+
+	    /* rotate */
+	    irbRotate(tree, grandparent, otherdir);
+
+	    /* recolour, move up */
+	    irbSetRed(irbNode(tree, parent), false);
+	    irbSetRed(irbNode(tree, grandparent), true);
+	    current = parent;
+
+	}
+
+    }
+
+    irbSetRed(irbNode(tree, tree->root), false);
+
+    /* return new node */
+    return irbNode(tree, ret);
+
+}
+
+/* binary search tree deletion with red-black tree fixup combined */
+void irbDeleteNode(IrbTree *tree, IrbNode *dnode) {
+
+    /* unbalanced parent, happy children, yay! */
+    uint32_t ubparent = IRB_NIL;
+    uint32_t node, parent, promoted;
+    IrbNode *n;
+    int dir = 0;
+    bool moved = false;
+
+    if(dnode == NULL) {
+	return;
+    }
+
+    node = irbIndex(tree, dnode);
+    n = dnode;
+
+    /* if the node to be deleted is has two children, we find the successor and work with it, since this is the node to delete */
+    if(n->children[RB_LEFT] != IRB_NIL && n->children[RB_RIGHT] != IRB_NIL) {
+
+	/* right first */
+	uint32_t successor = n->children[RB_RIGHT];
+	while(irbNode(tree, successor)->children[RB_LEFT] != IRB_NIL) {
+	    /* then left all the way */
+	    successor = irbNode(tree, successor)->children[RB_LEFT];
+	}
+
+	/* the deleted node's value goes, then copy the successor's data into old node, preserve colour */
+	irbFreeValue(tree, n);
+	n->key = irbNode(tree, successor)->key;
+#ifndef RBT_SET
+	n->value = irbNode(tree, successor)->value;
+#endif /* RBT_SET */
+
+	/* need to delete this guy now - his value lives on */
+	node = successor;
+	n = irbNode(tree, node);
+	moved = true;
+
+    }
+
+    /* at this point the node we are working with can ony have one child or zero children */
+
+    /* if node has one child, this leads us to it. if it has none, it will point to IRB_NIL */
+    promoted = n->children[n->children[RB_LEFT] == IRB_NIL];
+    parent = irbGetParent(n);
+
+    /* fix parent link - or root link */
+    if(parent == IRB_NIL) {
+	tree->root = promoted;
+    } else {
+	dir = irbDir(tree, node);
+	irbNode(tree, parent)->children[dir] = promoted;
+    }
+
+    /* fix promoted node's parent link */
+    if(promoted != IRB_NIL) {
+	irbSetParent(irbNode(tree, promoted), parent);
+    }
+
+    /* if node and node's child differ in colour, promoted node needs to be black to keep the black height, and we are done */
+    if(irbGetRed(n) != irbRed(tree, promoted)) {
+	if(!irbGetRed(n)) {
+	    irbSetRed(irbNode(tree, promoted), false);
+	}
+	tree->count--;
+	irbReleaseNode(tree, node, !moved);
+	return;
+    } else {
+	/* our disturbed node is removed, and instead of "double black" or other such nonsense, we track its parent and direction towards it */
+	ubparent = parent;
+	tree->count--;
+	irbReleaseNode(tree, node, !moved);
+    }
+
+    /* keep going as long as we have some rebalancing to do */
+    while(ubparent != IRB_NIL) {
+
+	int otherdir = !dir;
+	IrbNode *p = irbNode(tree, ubparent);
+	uint32_t ubsibling = p->children[otherdir];
+	IrbNode *s = irbNode(tree, ubsibling);
+
+	/* case 1: parent black, sibling red... the tree was balanced before, so if sibling red, parent must be black, recolour and continue */
+	if(irbGetRed(s)) {
+
+	    irbRotate(tree, ubparent, dir);
+	    irbSetRed(p, true);
+	    irbSetRed(s, false);
+
+	/* case 2: sibling black (because not red, above), has red child on opposite side to unbalanced node: rotate, recolour, done */
+	} else if(irbRed(tree, s->children[otherdir])) {
+
+	    irbSetRed(irbNode(tree, s->children[otherdir]), false);
+	    irbSetRed(s, irbGetRed(p));
+	    irbSetRed(p, false);
+	    irbRotate(tree, ubparent, dir);
+	    return;
+
+	/* case 3: sibling black, has red child on same side as deleted node: recolour, rotate and we turn into case 1 */
+	} else if(irbRed(tree, s->children[dir])) {
+
+	    irbSetRed(irbNode(tree, s->children[dir]), false);
+	    irbSetRed(s, true);
+	    irbRotate(tree, ubsibling, otherdir);
+
+	/* case 4: red parent: recolour, done */
+	} else if(irbGetRed(p)) {
+
+	    irbSetRed(p, false);
+	    irbSetRed(s, true);
+	    return;
+
+	/* case 5: parent and sibling black - mark sibling red and rebalance from parent */
+	} else {
+
+	    irbSetRed(s, true);
+	    if(irbGetParent(p) != IRB_NIL) {
+		/* no need to do this every time */
+		dir = irbDir(tree, ubparent);
+	    }
+	    ubparent = irbGetParent(p);
+
+	}
+
+    }
+
+}
+
+/* delete the node with the given key from red-black tree */
+void irbDeleteKey(IrbTree *tree, const uint32_t key) {
+
+    irbDeleteNode(tree, irbSearch(tree, key));
+
+}
+
+/* in-order tree traversal with depth and black height tracking, with a callback to call on each node */
+void irbInOrderTrack(IrbTree *tree, IrbCallback callback, void *user, const int dir) {
+
+    uint32_t current, tmp, last = IRB_NIL;
+
+    uint32_t nodenumber = 0;
+    int bh = 0, height = 0;
+    int otherdir = !dir;
+    int lastdir = otherdir;
+    bool cont = true;
+    PST_DECL(stack, uint32_t, 16);
+
+    current = tree->root;
+
+    if(current != IRB_NIL) {
+
+	PST_INIT(stack);
+
+	while ( cont && (PST_NONEMPTY(stack) || current != IRB_NIL) ) {
+
+	    if(current != IRB_NIL) {
+		/* push */
+		PST_PUSH_GROW(stack, current);
+
+		/* maintain running height and black height */
+		height++;
+		bh += irbBlack(tree, current);
+		if( lastdir == otherdir ) {
+		    height++;
+		}
+		last = current;
+		lastdir = dir;
+
+		current = irbNode(tree, current)->children[dir];
+	    } else {
+		/* pop */
+		current = PST_POP(stack);
+
+		/* maintain running height and black height */
+		if(current == last && lastdir == dir) {
+		    /* bounceback */
+		    height--;
+		} else {
+		    for(tmp = last; tmp != IRB_NIL && tmp != current; tmp = irbGetParent(irbNode(tree, tmp))) {
+			height--;
+			bh -= irbBlack(tree, tmp);
+		    }
+		}
+		lastdir = otherdir;
+
+		/* preserve the index first: this allows the callback to free the node if it wants that */
+		tmp = irbNode(tree, current)->children[otherdir];
+		last = current;
+		if(callback != NULL) {
+		    callback(tree, irbNode(tree, current), user, bh, height, &cont, nodenumber++);
+		}
+		current = tmp;
+
+	    }
+
+	}
+
+	PST_FREE(stack);
+
+    }
+
+}
+
+/* in-order tree traversal without depth and black height tracking, with a callback to call on each node */
+void irbInOrder(IrbTree *tree, IrbCallback callback, void *user, const int dir) {
+
+    uint32_t current, tmp;
+
+    uint32_t nodenumber = 0;
+    int otherdir = !dir;
+    bool cont = true;
+    PST_DECL(stack, uint32_t, 16);
+
+    current = tree->root;
+
+    if(current != IRB_NIL) {
+
+	PST_INIT(stack);
+
+	while ( cont && (PST_NONEMPTY(stack) || current != IRB_NIL) ) {
+
+	    if(current != IRB_NIL) {
+		/* push */
+		PST_PUSH_GROW(stack, current);
+		current = irbNode(tree, current)->children[dir];
+	    } else {
+		/* pop */
+		current = PST_POP(stack);
+		/* preserve the index first: this allows the callback to free the node if it wants that */
+		tmp = irbNode(tree, current)->children[otherdir];
+		if(callback != NULL) {
+		    callback(tree, irbNode(tree, current), user, 0, 0, &cont, nodenumber++);
+		}
+		current = tmp;
+	    }
+
+	}
+
+	PST_FREE(stack);
+
+    }
+
+}
+
+/* establish inclusive start and end of range in traversal order */
+static inline void irbRangeLimits(const int dir, const uint32_t low, const int lowqual, const uint32_t high, const int highqual,
+				    uint32_t *startrange, uint32_t *endrange) {
+
+    *startrange = low;
+    *endrange = high;
+
+    /* to-end ranges */
+    if(lowqual == RB_INF) *startrange = 0;
+    if(highqual == RB_INF) *endrange = ~0;
+    /* establish the range values */
+    if(highqual == RB_EXCL) (*endrange)--;
+    if(lowqual == RB_EXCL) (*startrange)++;
+
+    if(dir == RB_DESC) {
+	/* swap since we are going in the other direction */
+	uint32_t tmprange = *startrange;
+	*startrange = *endrange;
+	*endrange = tmprange;
+    }
+
+}
+
+/* in-order traversal over a specified range, returns count of nodes in range */
+uint32_t irbInOrderRange(IrbTree *tree, IrbCallback callback, void *user, const int dir,
+		const uint32_t low, const int lowqual, const uint32_t high, const int highqual) {
+
+    uint32_t current, tmp;
+    IrbNode *node;
+
+    uint32_t nodenumber = 0;
+    int otherdir = !dir;
+    bool cont = true;
+    uint32_t startrange, endrange;
+    PST_DECL(stack, uint32_t, 16);
+
+    PST_INIT(stack);
+
+    irbRangeLimits(dir, low, lowqual, high, highqual, &startrange, &endrange);
+
+    current = tree->root;
+
+    /* then we set up the stack for in-order traversal: only needs to contain the root and nodes where we turned in [dir] direction towards start range */
+
+    while(current != IRB_NIL) {
+
+	node = irbNode(tree, current);
+	int tmpdir = (startrange > node->key);
+
+	if(tmpdir == dir || node->key == startrange) {
+
+	    PST_PUSH_GROW(stack, current);
+
+	    if(node->key == startrange) {
+		current = IRB_NIL;
+		break;
+	    }
+	}
+
+	current = node->children[tmpdir];
+
+    }
+
+    /* the rest is a regular in-order traversal, just with a break clause */
+
+    while ( cont && (PST_NONEMPTY(stack) || current != IRB_NIL) ) {
+
+	if(current != IRB_NIL) {
+	    /* push */
+	    PST_PUSH_GROW(stack, current);
+	    current = irbNode(tree, current)->children[dir];
+	} else {
+	    /* pop */
+	    current = PST_POP(stack);
+	    node = irbNode(tree, current);
+
+	    /* dir left and key less than, or dir right and key greater than, processing ends */
+	    if(dir && (node->key < endrange)) {
+		break;
+	    }
+	    if(otherdir && (node->key > endrange)) {
+		break;
+	    }
+
+	    /* preserve the index first: this allows the callback to free the node if it wants that */
+	    tmp = node->children[otherdir];
+	    if(callback == NULL) {
+		nodenumber++;
+	    } else {
+		callback(tree, node, user, 0, 0, &cont, nodenumber++);
+	    }
+
+	    current = tmp;
+	}
+
+    }
+
+    PST_FREE(stack);
+
+    return nodenumber;
+
+}
+
+/* in-order traversal over a specified range (version with height / black height tracking), returns count of nodes in range */
+uint32_t irbInOrderRangeTrack(IrbTree *tree, IrbCallback callback, void *user, const int dir,
+		const uint32_t low, const int lowqual, const uint32_t high, const int highqual) {
+
+    uint32_t current, tmp, last = IRB_NIL;
+    IrbNode *node;
+
+    uint32_t nodenumber = 0;
+    int bh = 0, height = 0;
+    int otherdir = !dir;
+    int lastdir = otherdir;
+    bool cont = true;
+    uint32_t startrange, endrange;
+    PST_DECL(stack, uint32_t, 16);
+
+    PST_INIT(stack);
+
+    irbRangeLimits(dir, low, lowqual, high, highqual, &startrange, &endrange);
+
+    current = tree->root;
+
+    /* then we set up the stack for in-order traversal: only needs to contain the root and nodes where we turned in [dir] direction towards start range */
+
+    while(current != IRB_NIL) {
+
+	node = irbNode(tree, current);
+	int tmpdir = (startrange > node->key);
+
+	bh += !irbGetRed(node);
+	height++;
+	last = current;
+
+	if(tmpdir == dir || node->key == startrange) {
+
+	    PST_PUSH_GROW(stack, current);
+
+	    if(node->key == startrange) {
+		current = IRB_NIL;
+		break;
+	    }
+	}
+
+	current = node->children[tmpdir];
+
+    }
+
+    /* the rest is a regular in-order traversal, just with a break clause */
+
+    while ( cont && (PST_NONEMPTY(stack) || current != IRB_NIL) ) {
+
+	if(current != IRB_NIL) {
+	    /* push */
+	    PST_PUSH_GROW(stack, current);
+
+	    /* maintain running height and black height */
+	    height++;
+	    bh += irbBlack(tree, current);
+	    if( lastdir == otherdir ) {
+		height++;
+	    }
+	    last = current;
+	    lastdir = dir;
+
+	    current = irbNode(tree, current)->children[dir];
+	} else {
+	    /* pop */
+	    current = PST_POP(stack);
+	    node = irbNode(tree, current);
+
+	    /* maintain running height and black height */
+	    if(current == last && lastdir == dir) {
+		/* bounceback */
+		height--;
+	    } else {
+		for(tmp = last; tmp != IRB_NIL && tmp != current; tmp = irbGetParent(irbNode(tree, tmp))) {
+		    height--;
+		    bh -= irbBlack(tree, tmp);
+		}
+	    }
+	    lastdir = otherdir;
+
+	    /* dir left and key less than, or dir right and key greater than, processing ends */
+	    if(dir && (node->key < endrange)) {
+		break;
+	    }
+	    if(otherdir && (node->key > endrange)) {
+		break;
+	    }
+
+	    /* preserve the index first: this allows the callback to free the node if it wants that */
+	    tmp = node->children[otherdir];
+	    last = current;
+	    if(callback == NULL) {
+		nodenumber++;
+	    } else {
+		callback(tree, node, user, bh, height, &cont, nodenumber++);
+	    }
+
+	    current = tmp;
+	}
+
+    }
+
+    PST_FREE(stack);
+
+    return nodenumber;
+
+}
+
+/* breadth-first tree traversal with height and black height tracking */
+void irbBreadthFirstTrack(IrbTree *tree, IrbCallback callback, void *user, const int dir) {
+
+    int otherdir = !dir;
+    uint32_t nodenumber = 0;
+    bool cont = true;
+    DFQueue *queue = NULL;
+    IrbNodeInfo current = {1, 1, tree->root};
+    IrbNodeInfo tmp = current;
+    uint32_t walker = tree->root;
+    int bh = 0;
+
+    /* find black height to get a good approximation of queue size needed */
+    while(walker != IRB_NIL) {
+	bh += irbBlack(tree, walker);
+	walker = irbNode(tree, walker)->children[RB_LEFT];
+    }
+
+    queue = dfqCreate(2 << (bh + 1), sizeof(IrbNodeInfo), FQ_NO_SHRINK);
+
+    if(current.node != IRB_NIL) {
+
+	dfqPush(queue, &current);
+
+	while(cont && !queue->empty) {
+
+	    current = *(IrbNodeInfo*)dfqPop(queue);
+	    IrbNode *node = irbNode(tree, current.node);
+
+	    if((tmp.node = node->children[dir]) != IRB_NIL) {
+		tmp.height = current.height + 1;
+		tmp.bh = current.bh + irbBlack(tree, tmp.node);
+		dfqPush(queue, &tmp);
+	    }
+
+	    if((tmp.node = node->children[otherdir]) != IRB_NIL) {
+		tmp.height = current.height + 1;
+		tmp.bh = current.bh + irbBlack(tree, tmp.node);
+		dfqPush(queue, &tmp);
+	    }
+
+	    callback(tree, node, user, current.bh, current.height, &cont, nodenumber++);
+
+	}
+
+    }
+
+    dfqFree(queue);
+
+}
+
+/* breadth-first tree traversal without height and black height tracking */
+void irbBreadthFirst(IrbTree *tree, IrbCallback callback, void *user, const int dir) {
+
+    int otherdir = !dir;
+    uint32_t nodenumber = 0;
+    bool cont = true;
+    DFQueue *queue = NULL;
+    uint32_t current = tree->root;
+    int bh = 0;
+
+    /* find black height to get a good approximation of queue size needed */
+    while(current != IRB_NIL) {
+	bh += irbBlack(tree, current);
+	current = irbNode(tree, current)->children[RB_LEFT];
+    }
+
+    queue = dfqCreate(2 << ( bh + 1 ), sizeof(uint32_t), FQ_NO_SHRINK);
+
+    current = tree->root;
+
+    if(current != IRB_NIL) {
+
+	dfqPush(queue, &current);
+
+	while(cont && !queue->empty) {
+
+	    current = *(uint32_t*)dfqPop(queue);
+	    IrbNode *node = irbNode(tree, current);
+
+	    if(node->children[dir] != IRB_NIL) {
+		dfqPush(queue, &node->children[dir]);
+	    }
+
+	    if(node->children[otherdir] != IRB_NIL) {
+		dfqPush(queue, &node->children[otherdir]);
+	    }
+
+	    callback(tree, node, user, 0, 0, &cont, nodenumber++);
+
+	}
+
+    }
+
+    dfqFree(queue);
+
+}
+
+IrbNode* irbDumpCallback(IrbTree *tree, IrbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber) {
+
+    printf("key %d, %s, height %d, black height %d, parent %d%s%s\n",
+		    node->key, irbCname(node), height, bh,
+		    (irbGetParent(node) == IRB_NIL) ? 0 : irbNode(tree, irbGetParent(node))->key,
+		    (node->children[RB_LEFT] == IRB_NIL && node->children[RB_RIGHT] == IRB_NIL) ? ", no children" : "",
+		    (irbIndex(tree, node) == tree->root) ? ", is root" : ""
+    );
+
+    return node;
+
+}
+
+IrbNode* irbDummyCallback(IrbTree *tree, IrbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber) {
+
+    return node;
+
+}
+
+bool irbVerify(IrbTree *tree, bool chatty, bool stop) {
+
+    IrbVerifyState state = { 0, 0, true, chatty, stop };
+
+    if(tree == NULL) {
+	if(chatty) {
+	    fprintf(stderr, "Empty tree, valid (NULL is black)\n");
+	}
+	return true;
+    }
+
+    if(irbRed(tree, tree->root)) {
+	state.valid = false;
+	if(chatty) {
+	    fprintf(stderr, "Red root violation\n");
+	}
+	if(stop) {
+	    return false;
+	}
+    }
+
+    irbInOrderTrack(tree, irbVerifyCallback, &state, RB_ASC);
+
+    if(chatty) {
+
+	if(state.valid) {
+	    fprintf(stderr, "Valid red-black tree, node count %d, max height %d, black height %d\n", tree->count, state.maxheight, state.maxbh);
+	} else {
+	    fprintf(stderr, "Invalid red-black tree.\n");
+	}
+
+    }
+
+    return state.valid;
+
+}
+
+/* empty the tree and free it */
+void irbFree(IrbTree *tree) {
+
+    if(tree != NULL) {
+	irbEmpty(tree);
+	free(tree->nodes);
+	free(tree);
+    }
+
+}
+
+/* just empty the tree: free values if need be, then rewind the store */
+void irbEmpty(IrbTree *tree) {
+
+    if(tree != NULL) {
+
+	if(tree->freeCallback != NULL || (tree->flags & RB_PREALLOC)) {
+	    irbInOrder(tree, irbFreeValueCallback, NULL, RB_ASC);
+	}
+
+	tree->root = IRB_NIL;
+	tree->count = 0;
+	tree->used = 1;
+	tree->freelist = IRB_NIL;
+
+    }
+
+}
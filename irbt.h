@@ -0,0 +1,139 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   irbt.h
+ * @date   Fri Oct 16 14:02:00 2026
+ *
+ * @brief  index-linked red-black tree type and function declarations: nodes live in one contiguous
+ *         store and link to each other using 32-bit indices instead of pointers
+ *
+ */
+
+#ifndef IRBT_H_
+#define IRBT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* shared constants: RB_ASC, RB_LEFT, RB_INCL, RB_CHATTY, RB_PREALLOC and friends */
+#include "rbt.h"
+
+/* the "no node" index - store slot 0 is never used and always looks like a black leaf */
+#define IRB_NIL 0
+
+/* colour bit in the parent index, which limits the tree to 2^31 - 1 nodes */
+#define IRB_RED (1U << 31)
+#define IRB_MAXNODES (IRB_RED - 1)
+
+/* the tree node: 24 bytes on 64-bit platforms, 16 in a RBT_SET build */
+typedef struct {
+    uint32_t children[2];
+    uint32_t parent; /* parent index with colour in the top bit, use the accessors */
+    uint32_t key;
+#ifndef RBT_SET
+    void* value;
+#endif /* RBT_SET */
+} IrbNode;
+
+/*
+ * tree container. Node pointers returned by the API are only valid until the next insertion,
+ * because the node store may be moved by realloc - indices (irbIndex()) stay valid until the node is deleted.
+ * The whole tree is relocatable: the store can be copied verbatim (see irbCopy()).
+ */
+typedef struct {
+    IrbNode *nodes; /* node store, slot 0 unused */
+    void (*freeCallback) (void *value); /* callback to be called to free preallocated values */
+    size_t valuesize;
+    uint32_t root;
+    uint32_t count;
+    uint32_t capacity; /* slots in the store */
+    uint32_t used; /* slots ever handed out, including slot 0 */
+    uint32_t freelist; /* deleted slots, linked through children[RB_LEFT] */
+    unsigned int flags;
+} IrbTree;
+
+/* node accessors */
+#define irbNode(tree, index)		(&(tree)->nodes[index])
+#define irbIndex(tree, node)		((uint32_t)((node) - (tree)->nodes))
+#define irbGetParent(node)		((node)->parent & ~IRB_RED)
+#define irbGetRed(node)			((bool)((node)->parent >> 31))
+#define irbSetParent(node, p)		((node)->parent = (p) | ((node)->parent & IRB_RED))
+#define irbSetRed(node, r)		((node)->parent = ((node)->parent & ~IRB_RED) | ((r) ? IRB_RED : 0))
+
+/* callback typedef, same arguments and semantics as RbCallback */
+typedef IrbNode* (*IrbCallback) (IrbTree*, IrbNode*, void*, const int, const int, bool*, const uint32_t);
+#define IRB_CB_ARGS IrbTree *tree, IrbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber
+
+/* create an empty tree */
+IrbTree*	irbCreate();
+/* create an empty tree, but preallocate values (returns NULL in a RBT_SET build) */
+IrbTree*	irbCreatePrealloc(const size_t valuesize, void (*freeCallback) (void *value));
+/* make room for at least this many nodes in the store */
+void		irbReserve(IrbTree *tree, const uint32_t count);
+/* create an identical copy of the tree, duplicating any preallocated values */
+IrbTree*	irbCopy(IrbTree *tree);
+
+/* search for key, return node */
+IrbNode*	irbSearch(IrbTree *tree, const uint32_t key);
+
+/* insert key into tree, return new or existing node, NULL if the tree is full */
+IrbNode*	irbInsert(IrbTree *tree, const uint32_t key);
+
+/* delete node from tree */
+void		irbDeleteNode(IrbTree *tree, IrbNode *node);
+
+/* delete node with given key from tree */
+void		irbDeleteKey(IrbTree *tree, const uint32_t key);
+
+/* traversals, same semantics as their rb* counterparts */
+void		irbInOrderTrack(IrbTree *tree, IrbCallback callback, void *user, const int dir);
+uint32_t	irbInOrderRangeTrack(IrbTree *tree, IrbCallback callback, void *user, const int dir,
+			const uint32_t low, const int lowqual, const uint32_t high, const int highqual);
+void		irbInOrder(IrbTree *tree, IrbCallback callback, void *user, const int dir);
+uint32_t	irbInOrderRange(IrbTree *tree, IrbCallback callback, void *user, const int dir,
+			const uint32_t low, const int lowqual, const uint32_t high, const int highqual);
+void		irbBreadthFirstTrack(IrbTree *tree, IrbCallback callback, void *user, const int dir);
+void		irbBreadthFirst(IrbTree *tree, IrbCallback callback, void *user, const int dir);
+
+/* basic callback to print node information */
+IrbNode*	irbDumpCallback(IrbTree *tree, IrbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber);
+
+/* empty callback for traversal tests */
+IrbNode*	irbDummyCallback(IrbTree *tree, IrbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber);
+
+/* verify red-black tree invariants */
+bool		irbVerify(IrbTree *tree, bool chatty, bool stop);
+
+/* free tree nodes and tree */
+void		irbFree(IrbTree *tree);
+
+/* just free nodes - the node store is kept for reuse */
+void		irbEmpty(IrbTree *tree);
+
+#endif /* IRBT_H_ */
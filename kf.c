@@ -0,0 +1,248 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   kf.c
+ * @date   Fri Oct 16 19:05:00 2026
+ *
+ * @brief  approximate membership filters. The Bloom filter is split into cache line sized
+ *         blocks and a key sets one bit in each word of a single block, so that a lookup
+ *         costs one cache miss. The xor filter (Graf and Lemire) stores an 8-bit fingerprint
+ *         per slot in about 1.23 slots per key, such that the three slots of every key xor
+ *         to its fingerprint; it is built by peeling a 3-hypergraph and cannot take updates.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "xalloc.h"
+#include "kf.h"
+
+/* xor filter construction: seeds tried before giving up, and the seed sequence */
+#define KF_XOR_TRIES 64
+#define KF_XOR_SEED_STEP 0x9e3779b97f4a7c15ULL
+
+/* create a Bloom filter */
+KfBloom* kfBloomCreate(const uint32_t capacity, const uint32_t bitsperkey) {
+
+    KfBloom *ret;
+    uint64_t nblocks = ((uint64_t)capacity * bitsperkey + KF_BLOCK_BITS - 1) / KF_BLOCK_BITS;
+
+    if(nblocks == 0) {
+	nblocks = 1;
+    }
+
+    if(nblocks > UINT32_MAX) {
+	return NULL;
+    }
+
+    xcalloc(ret, 1, sizeof(KfBloom));
+    ret->nblocks = nblocks;
+
+    /* blocks[] starts on a cache line boundary, so that a block is one line */
+    xcalloc(ret->mem, nblocks + 1, KF_LINE);
+    ret->blocks = (uint64_t*)(((uintptr_t)ret->mem + KF_LINE - 1) & ~(uintptr_t)(KF_LINE - 1));
+
+    return ret;
+
+}
+
+/* remove all keys */
+void kfBloomClear(KfBloom *bloom) {
+
+    if(bloom != NULL) {
+	memset(bloom->blocks, 0, kfBloomSize(bloom));
+	bloom->count = 0;
+    }
+
+}
+
+/* free the filter */
+void kfBloomFree(KfBloom *bloom) {
+
+    if(bloom != NULL) {
+	free(bloom->mem);
+	free(bloom);
+    }
+
+}
+
+/* memory taken by the filter bits */
+size_t kfBloomSize(const KfBloom *bloom) {
+
+    return (bloom == NULL) ? 0 : (size_t)bloom->nblocks * KF_LINE;
+
+}
+
+/*
+ * expected false positive rate: blocks take a Poisson distributed number of keys, and an absent key gets through if
+ * each of the eight bits it tests in its block is set
+ */
+double kfBloomFpr(const KfBloom *bloom) {
+
+    const double load = (double)bloom->count / bloom->nblocks;
+    const double unset = 1.0 - 1.0 / (KF_BLOCK_BITS / KF_BLOCK_WORDS);
+    double p = exp(-load);
+    double q = 1.0;
+    double ret = 0.0;
+    uint32_t i;
+
+    /* p = probability of a block holding i keys, q = probability of a word bit still clear after i keys */
+    for(i = 0; i <= 2 * load + 64; i++) {
+	ret += p * pow(1.0 - q, KF_BLOCK_WORDS);
+	p *= load / (i + 1);
+	q *= unset;
+    }
+
+    return ret;
+
+}
+
+/* build an xor filter */
+KfXor* kfXorBuild(const uint32_t *keys, const uint32_t count) {
+
+    KfXor *ret;
+    uint64_t *masks;	/* per slot: xor of the hashes of all keys in the slot */
+    uint32_t *counts;	/* per slot: number of keys in the slot */
+    uint32_t *queue;	/* slots holding a single key */
+    uint64_t *stack;	/* peeled keys in order: hash... */
+    uint32_t *stackslot;	/* ...and the slot each was peeled from */
+    uint32_t slots, top, tries;
+    uint64_t seed = KF_XOR_SEED_STEP;
+
+    xcalloc(ret, 1, sizeof(KfXor));
+    ret->count = count;
+    ret->seglength = (32 + (uint32_t)(1.23 * count) + 2) / 3;
+    slots = 3 * ret->seglength;
+
+    xcalloc(ret->fingerprints, slots, sizeof(uint8_t));
+    xmalloc(masks, slots * sizeof(uint64_t));
+    xmalloc(counts, slots * sizeof(uint32_t));
+    xmalloc(queue, slots * sizeof(uint32_t));
+    xmalloc(stack, ((count > 0) ? count : 1) * sizeof(uint64_t));
+    xmalloc(stackslot, ((count > 0) ? count : 1) * sizeof(uint32_t));
+
+    for(tries = 0; tries < KF_XOR_TRIES; tries++, seed += KF_XOR_SEED_STEP) {
+
+	uint32_t head = 0, tail = 0;
+	uint32_t i;
+
+	ret->seed = seed;
+	top = 0;
+	memset(masks, 0, slots * sizeof(uint64_t));
+	memset(counts, 0, slots * sizeof(uint32_t));
+
+	for(i = 0; i < count; i++) {
+	    const uint64_t h = kfHash(keys[i], seed);
+	    int j;
+	    for(j = 0; j < 3; j++) {
+		const uint32_t slot = kfXorSlot(ret, h, j);
+		masks[slot] ^= h;
+		counts[slot]++;
+	    }
+	}
+
+	for(i = 0; i < slots; i++) {
+	    if(counts[i] == 1) {
+		queue[tail++] = i;
+	    }
+	}
+
+	/* peel: a slot with one key left pins that key, which is then removed from its other two slots */
+	while(head < tail) {
+
+	    const uint32_t slot = queue[head++];
+	    uint64_t h;
+	    int j;
+
+	    if(counts[slot] != 1) {
+		continue;
+	    }
+
+	    h = masks[slot];
+	    stack[top] = h;
+	    stackslot[top++] = slot;
+
+	    for(j = 0; j < 3; j++) {
+		const uint32_t other = kfXorSlot(ret, h, j);
+		masks[other] ^= h;
+		if(--counts[other] == 1) {
+		    queue[tail++] = other;
+		}
+	    }
+
+	}
+
+	if(top == count) {
+	    break;
+	}
+
+    }
+
+    /* assign in reverse peeling order: each key's pinned slot is the last of its three to be written */
+    if(top == count) {
+	while(top > 0) {
+	    const uint64_t h = stack[--top];
+	    const uint32_t slot = stackslot[top];
+	    uint8_t *fp = ret->fingerprints;
+	    fp[slot] = 0;
+	    fp[slot] = kfXorFingerprint(h) ^ fp[kfXorSlot(ret, h, 0)] ^ fp[kfXorSlot(ret, h, 1)] ^ fp[kfXorSlot(ret, h, 2)];
+	}
+    } else {
+	kfXorFree(ret);
+	ret = NULL;
+    }
+
+    free(masks);
+    free(counts);
+    free(queue);
+    free(stack);
+    free(stackslot);
+
+    return ret;
+
+}
+
+/* free the filter */
+void kfXorFree(KfXor *filter) {
+
+    if(filter != NULL) {
+	free(filter->fingerprints);
+	free(filter);
+    }
+
+}
+
+/* memory taken by the fingerprints */
+size_t kfXorSize(const KfXor *filter) {
+
+    return (filter == NULL) ? 0 : (size_t)3 * filter->seglength;
+
+}
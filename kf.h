@@ -0,0 +1,164 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   kf.h
+ * @date   Fri Oct 16 19:05:00 2026
+ *
+ * @brief  approximate membership filters for 32-bit keys: a blocked Bloom filter that
+ *         takes insertions, and a static xor filter built once from a fixed key set
+ *
+ */
+
+#ifndef KF_H_
+#define KF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* a Bloom filter block is one cache line of 64-bit words, every key sets one bit in each word of its block */
+#define KF_LINE 64
+#define KF_BLOCK_WORDS (KF_LINE / sizeof(uint64_t))
+#define KF_BLOCK_BITS (KF_LINE * 8)
+
+/* false positive rate of an 8-bit fingerprint xor filter, independent of the key count */
+#define KF_XOR_FPR (1.0 / 256)
+
+/* blocked Bloom filter: a lookup reads one cache line */
+typedef struct {
+    uint64_t *blocks;	/* nblocks * KF_BLOCK_WORDS words, cache line aligned */
+    void *mem;		/* allocation behind blocks[] */
+    uint32_t nblocks;
+    uint32_t count;	/* keys added since creation or the last kfBloomClear() */
+} KfBloom;
+
+/* xor filter: three fingerprint slots per key, one in each third of the array */
+typedef struct {
+    uint8_t *fingerprints;
+    uint64_t seed;
+    uint32_t seglength;	/* slots per third */
+    uint32_t count;	/* keys the filter was built from */
+} KfXor;
+
+/* 64-bit mix of a key (murmur3 finaliser), the hash behind both filters */
+static inline uint64_t kfHash(const uint32_t key, const uint64_t seed) {
+
+    uint64_t h = key + seed;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+
+}
+
+/* map a 32-bit hash onto [0, n) without division */
+static inline uint32_t kfReduce(const uint32_t hash, const uint32_t n) {
+
+    return (uint32_t)(((uint64_t)hash * n) >> 32);
+
+}
+
+/* Bloom filter block of a key, and the bit its hash selects in word i of the block */
+#define kfBloomBlock(bloom, h) ((bloom)->blocks + (size_t)kfReduce((uint32_t)((h) >> 32), (bloom)->nblocks) * KF_BLOCK_WORDS)
+#define kfBloomBit(h, i) ((uint64_t)1 << (((uint32_t)(h) * kfBloomSalt[(i)]) >> 26))
+
+/* odd multipliers deriving the eight bit positions from one 32-bit hash */
+static const uint32_t kfBloomSalt[KF_BLOCK_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+/* create a Bloom filter sized for capacity keys at bitsperkey bits each */
+KfBloom*	kfBloomCreate(const uint32_t capacity, const uint32_t bitsperkey);
+/* remove all keys */
+void		kfBloomClear(KfBloom *bloom);
+/* free the filter */
+void		kfBloomFree(KfBloom *bloom);
+/* memory taken by the filter bits, in bytes */
+size_t		kfBloomSize(const KfBloom *bloom);
+/* expected false positive rate with the keys added so far */
+double		kfBloomFpr(const KfBloom *bloom);
+
+/* add a key */
+static inline void kfBloomAdd(KfBloom *bloom, const uint32_t key) {
+
+    const uint64_t h = kfHash(key, 0);
+    uint64_t *block = kfBloomBlock(bloom, h);
+    unsigned int i;
+
+    for(i = 0; i < KF_BLOCK_WORDS; i++) {
+	block[i] |= kfBloomBit(h, i);
+    }
+
+    bloom->count++;
+
+}
+
+/* false if the key was never added, true if it (probably) was */
+static inline bool kfBloomQuery(const KfBloom *bloom, const uint32_t key) {
+
+    const uint64_t h = kfHash(key, 0);
+    const uint64_t *block = kfBloomBlock(bloom, h);
+    uint64_t miss = 0;
+    unsigned int i;
+
+    /* no early exit: the whole block is one cache line, and this loop vectorises */
+    for(i = 0; i < KF_BLOCK_WORDS; i++) {
+	miss |= ~block[i] & kfBloomBit(h, i);
+    }
+
+    return miss == 0;
+
+}
+
+/* build an xor filter from count distinct keys, NULL if that fails (duplicate keys) */
+KfXor*		kfXorBuild(const uint32_t *keys, const uint32_t count);
+/* free the filter */
+void		kfXorFree(KfXor *filter);
+/* memory taken by the fingerprints, in bytes */
+size_t		kfXorSize(const KfXor *filter);
+
+/* fingerprint of a hash and its three slots */
+#define kfXorFingerprint(h) ((uint8_t)((h) ^ ((h) >> 32)))
+#define kfXorSlot(filter, h, i) (kfReduce((uint32_t)(((h) << (21 * (i))) | ((h) >> ((64 - 21 * (i)) & 63))), (filter)->seglength) + (i) * (filter)->seglength)
+
+/* false if the key is not in the set the filter was built from, true if it (probably) is */
+static inline bool kfXorQuery(const KfXor *filter, const uint32_t key) {
+
+    const uint64_t h = kfHash(key, filter->seed);
+    const uint8_t *fp = filter->fingerprints;
+
+    return kfXorFingerprint(h) == (fp[kfXorSlot(filter, h, 0)] ^ fp[kfXorSlot(filter, h, 1)] ^ fp[kfXorSlot(filter, h, 2)]);
+
+}
+
+#endif /* KF_H_ */
@@ -0,0 +1,233 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   mp.c
+ * @date   Fri Oct 16 10:12:00 2026
+ *
+ * @brief  simple fixed-size item memory pool implementation. Not thread safe.
+ *         the pool was implemented mainly to take malloc() out of red-black tree node insertion and removal.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "xalloc.h"
+#include "mp.h"
+
+/* slab header, items follow, aligned to MP_ALIGN */
+typedef struct MpSlab MpSlab;
+struct MpSlab {
+    MpSlab *next;
+    size_t items;
+};
+
+#define MP_ALIGN 16
+#define MP_HDRSIZE ((sizeof(MpSlab) + MP_ALIGN - 1) & ~(size_t)(MP_ALIGN - 1))
+
+/* first item in a slab: right after the header, or at the next cache line boundary with MP_ALIGN_LINE */
+static inline char* mpFirstItem(MPool *pool, MpSlab *slab) {
+
+    char *ret = (char*)slab + MP_HDRSIZE;
+
+    if(pool->flags & MP_ALIGN_LINE) {
+	ret = (char*)(((uintptr_t)ret + MP_LINE - 1) & ~(uintptr_t)(MP_LINE - 1));
+    }
+
+    return ret;
+
+}
+
+/* create a pool */
+MPool* mpCreate(const size_t itemsize, const size_t slabitems, const unsigned int flags) {
+
+    MPool *ret;
+
+    if(itemsize == 0) {
+	return NULL;
+    }
+
+    xcalloc(ret, 1, sizeof(MPool));
+
+    /* every item must be able to hold the freelist link and keep pointer alignment */
+    ret->itemsize = (itemsize + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    if(flags & MP_ALIGN_LINE) {
+	ret->itemsize = (itemsize + MP_LINE - 1) & ~(size_t)(MP_LINE - 1);
+    }
+    ret->slabitems = (slabitems == 0) ? MP_MIN_SLAB_ITEMS : slabitems;
+    ret->users = 1;
+    ret->flags = flags;
+
+    return ret;
+
+}
+
+/* free all slabs and the pool itself, once nobody else uses it */
+void mpFree(MPool *pool) {
+
+    MpSlab *slab, *next;
+
+    if(pool != NULL && --pool->users == 0) {
+	for(slab = pool->slabs; slab != NULL; slab = next) {
+	    next = slab->next;
+	    free(slab);
+	}
+	free(pool);
+    }
+
+}
+
+/* share the pool */
+MPool* mpShare(MPool *pool) {
+
+    pool->users++;
+
+    return pool;
+
+}
+
+/* move another pool's slabs and free items into this one */
+void mpMerge(MPool *pool, MPool *from) {
+
+    MpSlab *slab;
+    void **item;
+
+    if(pool == from || from->slabs == NULL) {
+	return;
+    }
+
+    /* the other slabs go behind ours, so that our newest one stays first */
+    if(pool->slabs == NULL) {
+	pool->slabs = from->slabs;
+    } else {
+	for(slab = pool->slabs; slab->next != NULL; slab = slab->next);
+	slab->next = from->slabs;
+    }
+
+    pool->slabcount += from->slabcount;
+    pool->capacity += from->capacity;
+
+    /* one freelist in front of the other */
+    if(from->freelist != NULL) {
+	for(item = from->freelist; *item != NULL; item = *item);
+	*item = pool->freelist;
+	pool->freelist = from->freelist;
+    }
+
+    /* only one slab can be carved from: keep whichever has more room left, the rest of the other one goes with it */
+    if(from->end - from->next > pool->end - pool->next) {
+	pool->next = from->next;
+	pool->end = from->end;
+    }
+
+    from->slabs = from->freelist = NULL;
+    from->next = from->end = NULL;
+    from->slabcount = from->capacity = 0;
+
+}
+
+/* release all items at once: drop every slab but the largest one (not always the newest, after mpReserve() or mpMerge()) and rewind it */
+void mpReset(MPool *pool) {
+
+    MpSlab *slab, *next;
+    MpSlab *keep = pool->slabs;
+
+    if(keep == NULL) {
+	return;
+    }
+
+    for(slab = keep->next; slab != NULL; slab = slab->next) {
+	if(slab->items > keep->items) {
+	    keep = slab;
+	}
+    }
+
+    for(slab = pool->slabs; slab != NULL; slab = next) {
+	next = slab->next;
+	if(slab != keep) {
+	    free(slab);
+	}
+    }
+
+    keep->next = NULL;
+    pool->slabs = keep;
+    pool->slabcount = 1;
+    pool->capacity = keep->items;
+    pool->freelist = NULL;
+    pool->next = mpFirstItem(pool, keep);
+    pool->end = pool->next + keep->items * pool->itemsize;
+
+}
+
+/* allocate a new slab and hand out its first item */
+void* mpGrow(MPool *pool) {
+
+    MpSlab *slab;
+    size_t items = pool->slabitems;
+
+    /* room to align the first item if needed */
+    xmalloc(slab, MP_HDRSIZE + items * pool->itemsize + ((pool->flags & MP_ALIGN_LINE) ? MP_LINE : 0));
+
+    slab->items = items;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->slabcount++;
+    pool->capacity += items;
+
+    /* grow geometrically so that big trees end up with few, large slabs */
+    if(!(pool->flags & MP_NO_GROW) && items < MP_MAX_SLAB_ITEMS) {
+	pool->slabitems = items << 1;
+    }
+
+    pool->next = mpFirstItem(pool, slab);
+    pool->end = pool->next + items * pool->itemsize;
+    pool->next += pool->itemsize;
+
+    return pool->next - pool->itemsize;
+
+}
+
+/* add a slab of given size and make it current */
+void mpReserve(MPool *pool, const size_t items) {
+
+    size_t slabitems = pool->slabitems;
+
+    if(items == 0) {
+	return;
+    }
+
+    /* one-off slab size, then hand the first item back */
+    pool->slabitems = items;
+    mpGrow(pool);
+    pool->next -= pool->itemsize;
+    pool->slabitems = slabitems;
+
+}
@@ -0,0 +1,112 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   mp.h
+ * @date   Fri Oct 16 10:12:00 2026
+ *
+ * @brief  simple fixed-size item memory pool: items are carved from large slabs,
+ *         released items go onto a freelist, all slabs can be dropped at once
+ *
+ */
+
+#ifndef MP_H_
+#define MP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* initial number of items in a slab, doubled for every new slab up to MP_MAX_SLAB_ITEMS */
+#define MP_MIN_SLAB_ITEMS 256
+#define MP_MAX_SLAB_ITEMS 65536
+
+/* pool structure */
+typedef struct {
+    void *slabs;	/* singly linked list of slabs, newest first */
+    void *freelist;	/* released items, linked through their first word */
+    char *next;		/* next unused item in the newest slab */
+    char *end;		/* end of the newest slab */
+    size_t itemsize;
+    size_t slabitems;	/* item count of the next slab to be allocated */
+    size_t slabcount;
+    size_t capacity;	/* total number of items in all slabs */
+    unsigned int users;	/* owners sharing the pool, see mpShare() */
+    unsigned int flags;
+} MPool;
+
+#define MP_NONE		0
+#define MP_NO_GROW	(1<<0) /* keep every slab at the initial size */
+#define MP_ALIGN_LINE	(1<<1) /* cache line aligned items, item size rounded up to whole cache lines */
+
+/* cache line size assumed by MP_ALIGN_LINE */
+#define MP_LINE 64
+
+/* allocate and initialise a new pool of items of given size, slabitems = 0 selects the default */
+MPool*		mpCreate(const size_t itemsize, const size_t slabitems, const unsigned int flags);
+/* let go of the pool: the pool and all of its slabs are freed once its last user does this */
+void		mpFree(MPool *pool);
+/* one more user of the pool, returns the pool */
+MPool*		mpShare(MPool *pool);
+/* take over all slabs and free items of another pool of the same item size, which is left empty */
+void		mpMerge(MPool *pool, MPool *from);
+/* release all items at once, keeping the largest slab only */
+void		mpReset(MPool *pool);
+/* add a new slab and return a pointer to the first item - slow path of mpAlloc */
+void*		mpGrow(MPool *pool);
+/* add a new slab of exactly given item count and make it current, so that the next items allocated are contiguous */
+void		mpReserve(MPool *pool, const size_t items);
+
+/* get an item from the pool: freelist first, then the current slab, then a new slab */
+static inline void* mpAlloc(MPool *pool) {
+
+    void *ret = pool->freelist;
+
+    if(ret != NULL) {
+	pool->freelist = *(void**)ret;
+	return ret;
+    }
+
+    if(pool->next < pool->end) {
+	ret = pool->next;
+	pool->next += pool->itemsize;
+	return ret;
+    }
+
+    return mpGrow(pool);
+
+}
+
+/* return an item to the pool */
+static inline void mpRelease(MPool *pool, void *item) {
+
+    *(void**)item = pool->freelist;
+    pool->freelist = item;
+
+}
+
+#endif /* MP_H_ */
@@ -29,8 +29,9 @@
  * @file   rbt.c
  * @date   Fri Sep 14 23:27:00 2018
  *
- * @brief  a simple non-thread safe red-black tree implementation with traversal and verification.
- *         all core functions are iterative (non-recursive), but do use stacks and queues.
+ * @brief  a simple red-black tree implementation with traversal and verification. Trees are not thread
+ *         safe, but set operations split their work over a thread pool. Core functions are iterative, using
+ *         stacks and queues - bulk building, split / join and set operations recurse, as deep as the tree is high.
  */
 
 #include <stdio.h>
@@ -43,13 +44,14 @@
 #include "fq.h"
 #include "st_inline.h"
 #include "xalloc.h"
+#include "tp.h"
 
 #include "rbt.h"
 
 /* helper macros */
-#define rbRed(var) (var != NULL && var->red)
-#define rbBlack(var) (var == NULL || !var->red)
-#define rbDir(var) (var == var->parent->children[RB_RIGHT])
+#define rbRed(var) (var != NULL && rbGetRed(var))
+#define rbBlack(var) (var == NULL || !rbGetRed(var))
+#define rbDir(var) (var == rbGetParent(var)->children[RB_RIGHT])
 #define rbCname(var) (rbBlack(var) ? "black" : "red")
 
 /* red-black tree verification state container */
@@ -68,403 +70,2825 @@ typedef struct {
     RbNode* node;
 } RbNodeInfo;
 
+/* thread's shared node pool for RB_POOL_TLS trees, and the number of trees using it */
+static __thread MPool *rbTlsPool = NULL;
+static __thread uint32_t rbTlsRefs = 0;
+
+/* thread pool for parallel set operations, started on first use, and its size (0 = one thread per online CPU) */
+static TPool *rbThreadPool = NULL;
+static unsigned int rbThreads = 0;
+static pthread_mutex_t rbThreadLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* hot key cache slot for key: multiplicative (Fibonacci) hashing spreads clustered keys */
+static inline RbNode** rbCacheSlot(RbCache *cache, const uint32_t key) {
+
+    return cache->slots + ((uint32_t)(key * 2654435769U) >> cache->shift);
+
+}
+
+/* allocate an empty hash index of 2^bits slots */
+static RbHash* rbHashCreate(const uint32_t bits) {
+
+    RbHash *ret;
+
+    xcalloc(ret, 1, sizeof(RbHash));
+    xcalloc(ret->slots, (size_t)1 << bits, sizeof(RbHashSlot));
+    ret->mask = ((uint32_t)1 << bits) - 1;
+    ret->shift = 32 - bits;
+
+    return ret;
+
+}
+
+/* free the hash index */
+static void rbHashFree(RbHash *hash) {
+
+    if(hash != NULL) {
+	free(hash->slots);
+	free(hash);
+    }
+
+}
+
+/* home slot of a key in the hash index, same hashing as the hot key cache */
+static inline uint32_t rbHashHome(const RbHash *hash, const uint32_t key) {
+
+    return (uint32_t)(key * 2654435769U) >> hash->shift;
+
+}
+
+/* node with key from the hash index, NULL if there is none */
+static inline RbNode* rbHashGet(const RbHash *hash, const uint32_t key) {
+
+    uint32_t i = rbHashHome(hash, key);
+
+    /* the load factor stays at or below 1/2, so there always is an empty slot to stop at */
+    while(hash->slots[i].node != NULL) {
+	if(hash->slots[i].key == key) {
+	    return hash->slots[i].node;
+	}
+	i = (i + 1) & hash->mask;
+    }
+
+    return NULL;
+
+}
+
+/* add a node whose key is not in the hash index yet */
+static inline void rbHashAdd(RbHash *hash, RbNode *node) {
+
+    uint32_t i = rbHashHome(hash, node->key);
+
+    while(hash->slots[i].node != NULL) {
+	i = (i + 1) & hash->mask;
+    }
+
+    hash->slots[i].node = node;
+    hash->slots[i].key = node->key;
+
+}
+
+/* double the hash index slot count and re-add every node */
+static void rbHashGrow(RbTree *tree) {
+
+    RbHash *old = tree->hash;
+    uint32_t i;
+
+    tree->hash = rbHashCreate(33 - old->shift);
+
+    for(i = 0; i <= old->mask; i++) {
+	if(old->slots[i].node != NULL) {
+	    rbHashAdd(tree->hash, old->slots[i].node);
+	}
+    }
+
+    rbHashFree(old);
+
+}
+
+/* remove a node from the hash index: entries behind it in its probe run move back, so that no tombstones are needed */
+static void rbHashRemove(RbHash *hash, RbNode *node) {
+
+    uint32_t i = rbHashHome(hash, node->key);
+    uint32_t j;
+
+    while(hash->slots[i].node != node) {
+	if(hash->slots[i].node == NULL) {
+	    return;
+	}
+	i = (i + 1) & hash->mask;
+    }
+
+    /* i is the hole: move back the next entry whose home slot is not within (i, j] (cyclically) */
+    for(j = (i + 1) & hash->mask; hash->slots[j].node != NULL; j = (j + 1) & hash->mask) {
+
+	const uint32_t home = rbHashHome(hash, hash->slots[j].key);
+
+	if(((j - home) & hash->mask) >= ((j - i) & hash->mask)) {
+	    hash->slots[i] = hash->slots[j];
+	    i = j;
+	}
+
+    }
+
+    hash->slots[i].node = NULL;
+
+}
+
+/* rebuild the negative lookup filter from the keys in the tree, sized for twice as many keys */
+static void rbFilterRebuild(RbTree *tree) {
+
+    RbFilter *filter = tree->filter;
+    RbNode *node;
+
+    /* the tree is walked anyway: a tree with a filter is always counted */
+    rbCount(tree);
+
+    if(tree->count < RB_FILTER_MIN / 2) {
+	filter->capacity = RB_FILTER_MIN;
+    } else {
+	filter->capacity = (tree->count > UINT32_MAX / 2) ? UINT32_MAX : 2 * tree->count;
+    }
+
+    kfBloomFree(filter->bloom);
+    filter->bloom = kfBloomCreate(filter->capacity, filter->bitsperkey);
+    filter->stale = 0;
+    filter->rebuilds++;
+
+    for(node = rbFirst(tree); node != NULL; node = rbNext(node)) {
+	kfBloomAdd(filter->bloom, node->key);
+    }
+
+}
+
+/*
+ * removed keys have left the tree, now of count keys, but stay in the negative lookup filter: rebuild it once they
+ * outnumber half the live keys (amortised O(1) per deletion), but not before there are a few - or small trees would
+ * rebuild on every deletion
+ */
+static inline void rbFilterStale(RbTree *tree, const uint32_t removed, const uint32_t count) {
+
+    RbFilter *filter = tree->filter;
+
+    if(filter != NULL && (filter->stale += removed) > count / 2 && filter->stale >= RB_FILTER_MIN_STALE) {
+	rbFilterRebuild(tree);
+    }
+
+}
+
 /* it is what it is */
-static inline RbNode* rbCreateNode(RbNode *parent, uint32_t key) {
+static inline RbNode* rbCreateNode(RbTree *tree, RbNode *parent, uint32_t key) {
 
     RbNode *ret;
 
-    xmalloc(ret, sizeof(RbNode));
+    if(tree->pool != NULL) {
+	ret = mpAlloc(tree->pool);
+    } else {
+	xmalloc(ret, tree->nodesize);
+    }
     ret->children[0] = ret->children[1] = NULL;
-    ret->parent = parent;
+    rbInitParent(ret, parent, true);
+#ifndef RBT_SET
     ret->value = NULL;
+    /* preallocated values live right behind the node, or in the value slot itself if they fit */
+    if(tree->flags & RB_PREALLOC) {
+	if(tree->valuesize > sizeof(void*)) {
+	    ret->value = memset(ret + 1, 0, tree->valuesize);
+	}
+    }
+#endif /* RBT_SET */
     ret->key = key;
 
     return ret;
 }
 
-/* replace one node with another (pointer replacement, not key/value swap) */
-#if 0 /* unused for now */
-static inline void rbReplaceNode(RbTree *tree, RbNode *a, RbNode *b) {
+/* return node memory to wherever it came from */
+static inline void rbReleaseNode(RbTree *tree, RbNode *node) {
+
+    if(tree->pool != NULL) {
+	mpRelease(tree->pool, node);
+    } else {
+	free(node);
+    }
+
+}
+
+/* free node value, if we own it */
+static inline void rbFreeValue(RbTree *tree, RbNode *node) {
+#ifndef RBT_SET
+
+    if(tree->freeCallback != NULL) {
+	tree->freeCallback((tree->flags & RB_PREALLOC) ? rbValue(tree, node) : node->value);
+    }
+#endif /* RBT_SET */
+}
+
+/* free node value and the node itself */
+static inline void rbDestroyNode(RbTree *tree, RbNode *node) {
+
+    rbFreeValue(tree, node);
+    rbReleaseNode(tree, node);
+
+}
+
+/*
+ * swap a node with two children and its in-order successor within the tree, colours included
+ * (pointer replacement, not key/value swap): nodes keep their identity and their values stay put
+ */
+static inline void rbSwapSuccessor(RbTree *tree, RbNode *node, RbNode *successor) {
+
+    RbNode *parent = rbGetParent(node);
+    RbNode *sparent = rbGetParent(successor);
+    RbNode *sright = successor->children[RB_RIGHT];
+    bool red = rbGetRed(node);
+
+    /* successor takes the node's place */
+    successor->children[RB_LEFT] = node->children[RB_LEFT];
+    rbSetParent(successor->children[RB_LEFT], successor);
+
+    if(sparent == node) {
+	/* successor is the node's right child */
+	successor->children[RB_RIGHT] = node;
+	rbSetParent(node, successor);
+    } else {
+	/* successor is a left child somewhere down the right subtree */
+	successor->children[RB_RIGHT] = node->children[RB_RIGHT];
+	rbSetParent(successor->children[RB_RIGHT], successor);
+	sparent->children[RB_LEFT] = node;
+	rbSetParent(node, sparent);
+    }
+
+    rbSetParent(successor, parent);
+    if(parent == NULL) {
+	tree->root = successor;
+    } else {
+	parent->children[parent->children[RB_RIGHT] == node] = successor;
+    }
+
+    /* node takes the successor's place: no left child, maybe a right child */
+    node->children[RB_LEFT] = NULL;
+    node->children[RB_RIGHT] = sright;
+    if(sright != NULL) {
+	rbSetParent(sright, node);
+    }
+
+    rbSetRed(node, rbGetRed(successor));
+    rbSetRed(successor, red);
+
+#ifdef RBT_ORDSTAT
+    {
+	uint32_t size = node->size;
+	node->size = successor->size;
+	successor->size = size;
+    }
+#endif /* RBT_ORDSTAT */
+
+}
+
+/* add a newly linked node to the hash index and the negative lookup filter, if the tree has them */
+static inline void rbIndexNode(RbTree *tree, RbNode *node) {
+
+    /* grow the hash index before it gets over half full */
+    if(tree->hash != NULL) {
+	if(tree->count > (tree->hash->mask + 1) / 2 && tree->hash->shift > 1) {
+	    rbHashGrow(tree);
+	}
+	rbHashAdd(tree->hash, node);
+    }
+
+    /* the filter takes the new key, or is rebuilt (new key included) once it is full - never the case in an empty tree */
+    if(tree->filter != NULL) {
+	if(tree->filter->bloom->count < tree->filter->capacity) {
+	    kfBloomAdd(tree->filter->bloom, node->key);
+	} else {
+	    rbFilterRebuild(tree);
+	}
+    }
+
+}
+
+/* a node is going away: it must not be found in the cache or the hash index */
+static inline void rbForgetNode(RbTree *tree, RbNode *node) {
+
+    if(tree->cache != NULL) {
+	RbNode **slot = rbCacheSlot(tree->cache, node->key);
+	if(*slot == node) {
+	    *slot = NULL;
+	}
+    }
+
+    if(tree->hash != NULL) {
+	rbHashRemove(tree->hash, node);
+    }
+
+}
+
+/*
+ * binary search tree insertion below start (the root, or a node whose subtree bounds the key), return newly added node -
+ * or existing node if found. Links the given node, or creates one if NULL
+ */
+static inline RbNode* bstInsert(RbTree *tree, RbNode *start, const uint32_t key, RbNode *node) {
+
+    RbNode* current = start;
+    RbNode* parent = NULL;
+    int dir = 0;
+
+    /* find the parent to attach new node, return if already exists */
+    while(current != NULL) {
+
+	if(current->key == key) {
+	    return current;
+	}
+
+	parent = current;
+	dir = ( key > current->key );
+	current = current->children[dir];
+
+    }
+
+    /* create a new node (or take the caller's), it is born red */
+    if(node == NULL) {
+	current = rbCreateNode(tree, parent, key);
+    } else {
+	current = node;
+	current->children[0] = current->children[1] = NULL;
+	rbInitParent(current, parent, true);
+    }
+
+    tree->count++;
+
+    /* link parent with new node */
+    if(parent != NULL) {
+	parent->children[dir] = current;
+    }
+
+    /* a new lowest (highest) key can only be linked left (right) of the old one. Rotations never change either */
+    if(parent == NULL) {
+	tree->min = tree->max = current;
+    } else if(parent == tree->min && dir == RB_LEFT) {
+	tree->min = current;
+    } else if(parent == tree->max && dir == RB_RIGHT) {
+	tree->max = current;
+    }
+
+    rbIndexNode(tree, current);
+
+#ifdef RBT_ORDSTAT
+    /* one more node in every subtree on the way up */
+    current->size = 1;
+    for(; parent != NULL; parent = rbGetParent(parent)) {
+	parent->size++;
+    }
+#endif /* RBT_ORDSTAT */
+
+    return current;
+
+}
+
+/* perform a rotation of the given node in given direction */
+static inline void rbRotate(RbTree *tree, RbNode *root, const int dir) {
+
+    /* pivot node */
+    RbNode *pivot = root->children[!dir];
 
-    memcpy(b, a, sizeof(RbNode));
+    /* swapsies */
+    root->children[!dir] = pivot->children[dir];
+    if(pivot->children[dir] != NULL) {
+	rbSetParent(pivot->children[dir], root);
+    }
+    pivot->children[dir] = root;
+    rbSetParent(pivot, rbGetParent(root));
+    rbSetParent(root, pivot);
 
-    if(a->parent == NULL) {
-	tree->root = b;
+    /* link parent to pivot, or update tree root if pivot is the new root */
+    if(rbGetParent(pivot) == NULL) {
+	tree->root = pivot;
     } else {
-	b->parent->children[rbDir(a)] = b;
+	int pdir = (rbGetParent(pivot)->children[RB_RIGHT] == root);
+	rbGetParent(pivot)->children[pdir] = pivot;
+    }
+
+#ifdef RBT_ORDSTAT
+    /* pivot now heads the whole subtree, root lost the pivot's far side */
+    pivot->size = root->size;
+    root->size = 1 + rbSize(root->children[RB_LEFT]) + rbSize(root->children[RB_RIGHT]);
+#endif /* RBT_ORDSTAT */
+
+}
+
+/* callback freeing a node */
+static RbNode* rbFreeCallback(RbTree *tree, RbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber) {
+
+    if(node == tree->root) {
+	tree->root = NULL;
+    }
+
+    rbDestroyNode(tree, node);
+
+    return NULL;
+}
+
+/* callback freeing a node's value only, used when node memory goes away with the pool */
+static RbNode* rbFreeValueCallback(RbTree *tree, RbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber) {
+
+    rbFreeValue(tree, node);
+
+    return node;
+}
+
+/* callback used for tree verification */
+static RbNode* rbVerifyCallback(RbTree *tree, RbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber) {
+
+    RbVerifyState *state = user;
+
+    if(node != NULL) {
+
+	if(height > state->maxheight) {
+	    state->maxheight = height;
+	}
+
+	/* check black height of node with zero or one child */
+	if(node->children[RB_LEFT] == NULL || node->children[RB_RIGHT] == NULL) {
+
+	    if(state->maxbh == 0) {
+		state->maxbh = bh;
+	    }
+
+	    /* if we see any changes in black height, tree is invalid */
+	    if(bh != state->maxbh) {
+		state->valid = false;
+		if(state->chatty) {
+		    fprintf(stderr, "Black height violation: key %d black height %d != previous black height seen %d\n", node->key, bh, state->maxbh);
+		}
+		if(state->stop) {
+		    *cont = false;
+		    return node;
+		}
+		state->maxbh = bh;
+	    }
+
+	}
+
+#ifdef RBT_ORDSTAT
+	if(node->size != 1 + rbSize(node->children[RB_LEFT]) + rbSize(node->children[RB_RIGHT])) {
+	    state->valid = false;
+	    if(state->chatty) {
+		fprintf(stderr, "Subtree size violation: key %d size %d\n", node->key, node->size);
+	    }
+	    if(state->stop) {
+		    *cont = false;
+	    }
+	}
+#endif /* RBT_ORDSTAT */
+
+	if(rbGetRed(node) && rbRed(rbGetParent(node))) {
+	    state->valid = false;
+	    if(state->chatty) {
+		fprintf(stderr, "Red-red violation: key %d red -> parent key %d red\n", node->key, rbGetParent(node)->key);
+	    }
+	    if(state->stop) {
+		    *cont = false;
+	    }
+	}
+
     }
 
-    if(b->children[RB_LEFT] != NULL) {
-	b->children[RB_LEFT]->parent = b;
+    return node;
+
+}
+
+/* create a red-black tree */
+RbTree* rbCreate() {
+
+    RbTree *ret;
+
+    xcalloc(ret, 1, sizeof(RbTree));
+    ret->nodesize = sizeof(RbNode);
+
+    return ret;
+
+}
+
+/* create a red-black tree that will pre-allocate values of given size on insertion */
+RbTree* rbCreatePrealloc(const size_t valuesize, void (*freeCallback) (void *value)) {
+
+    return rbCreateExt(RB_PREALLOC, valuesize, freeCallback);
+
+}
+
+/* create a red-black tree allocating nodes from a pool - own pool, or the thread's shared pool with RB_POOL_TLS */
+RbTree* rbCreatePool(const unsigned int flags) {
+
+    return rbCreateExt(flags | RB_POOL, 0, NULL);
+
+}
+
+/* create an arena-backed red-black tree, with values of given size preallocated from the arena if valuesize > 0 */
+RbTree* rbCreateArena(const size_t valuesize, void (*freeCallback) (void *value)) {
+
+    return rbCreateExt(RB_ARENA | ((valuesize > 0) ? RB_PREALLOC : 0), valuesize, freeCallback);
+
+}
+
+/* create an intrusive red-black tree, linking caller-owned nodes */
+RbTree* rbCreateIntrusive() {
+
+    return rbCreateExt(RB_INTRUSIVE, 0, NULL);
+
+}
+
+/* create a red-black tree with given flags */
+RbTree* rbCreateExt(const unsigned int flags, const size_t valuesize, void (*freeCallback) (void *value)) {
+
+    RbTree *ret;
+
+#ifdef RBT_SET
+    /* a set has no values to preallocate */
+    if(flags & RB_PREALLOC) {
+	return NULL;
+    }
+#endif
+
+    ret = rbCreate();
+
+    if(ret != NULL) {
+
+	ret->freeCallback = freeCallback;
+	ret->flags = flags;
+
+	if(flags & RB_HASH) {
+	    uint32_t bits = 0;
+	    while(((uint32_t)1 << bits) < RB_HASH_MIN) {
+		bits++;
+	    }
+	    ret->hash = rbHashCreate(bits);
+	}
+
+	/* intrusive trees never allocate nodes (the hash index is the tree's own) */
+	if(flags & RB_INTRUSIVE) {
+	    ret->flags = RB_INTRUSIVE | (flags & RB_HASH);
+	    ret->freeCallback = NULL;
+	    return ret;
+	}
+
+	/* an arena is always private */
+	if(flags & RB_ARENA) {
+	    ret->flags &= ~RB_POOL_TLS;
+	    ret->flags |= RB_POOL;
+	}
+
+	if(flags & RB_PREALLOC) {
+	    ret->valuesize = valuesize;
+	    if(valuesize > sizeof(void*)) {
+		ret->nodesize += valuesize;
+		/* the thread's pool only holds plain nodes */
+		if(ret->flags & RB_POOL_TLS) {
+		    ret->flags &= ~RB_POOL_TLS;
+		    ret->flags |= RB_POOL;
+		}
+	    }
+	}
+
+	if(ret->flags & RB_POOL_TLS) {
+	    if(rbTlsPool == NULL) {
+		rbTlsPool = mpCreate(sizeof(RbNode), 0, MP_NONE);
+	    }
+	    rbTlsRefs++;
+	    ret->pool = rbTlsPool;
+	    ret->flags |= RB_POOL;
+	} else if(ret->flags & RB_POOL) {
+	    ret->pool = mpCreate(ret->nodesize, 0, MP_NONE);
+	}
+
+    }
+
+    return ret;
+}
+
+/*
+ * bulk build state: nodes in key order - either fresh ones in one block, to be filled from the source arrays,
+ * or existing ones (links) to be relinked as they are - and the one depth whose nodes are red
+ */
+typedef struct {
+    char *nodes;
+    size_t stride;
+    RbNode **links;
+    const uint32_t *keys;
+    void **values;
+    int reddepth;
+} RbBuildState;
+
+/* i-th node in key order */
+static inline RbNode* rbBuildNode(RbBuildState *state, const uint32_t i) {
+
+    return (state->links != NULL) ? state->links[i] : (RbNode*)(state->nodes + (size_t)i * state->stride);
+
+}
+
+/* build the subtree holding keys [low, high) around its middle key, return its root */
+static RbNode* rbBuildRange(RbBuildState *state, RbNode *parent, const uint32_t low, const uint32_t high, const int depth) {
+
+    const uint32_t mid = low + (high - low) / 2;
+    RbNode *node;
+
+    if(low >= high) {
+	return NULL;
+    }
+
+    node = rbBuildNode(state, mid);
+    if(state->links == NULL) {
+	node->key = state->keys[mid];
+#ifndef RBT_SET
+	node->value = (state->values == NULL) ? NULL : state->values[mid];
+#endif /* RBT_SET */
+    }
+#ifdef RBT_ORDSTAT
+    node->size = high - low;
+#endif /* RBT_ORDSTAT */
+    rbInitParent(node, parent, depth == state->reddepth);
+    node->children[RB_LEFT] = rbBuildRange(state, node, low, mid, depth + 1);
+    node->children[RB_RIGHT] = rbBuildRange(state, node, mid + 1, high, depth + 1);
+
+    return node;
+
+}
+
+/* make the tree a perfectly balanced one of the n nodes in the build state */
+static void rbBuildTree(RbTree *tree, RbBuildState *state, const uint32_t n) {
+
+    int levels = 0;
+
+    /* subtree sizes differ by one at most, so every leaf is on one of the two deepest levels */
+    while(((uint64_t)1 << levels) - 1 < n) {
+	levels++;
+    }
+
+    /* a full bottom level stays black, an incomplete one is red: all paths then have levels - 1 black nodes */
+    state->reddepth = (((uint64_t)1 << levels) - 1 == n) ? -1 : levels - 1;
+
+    tree->root = rbBuildRange(state, NULL, 0, n, 0);
+    tree->min = (n == 0) ? NULL : rbBuildNode(state, 0);
+    tree->max = (n == 0) ? NULL : rbBuildNode(state, n - 1);
+    tree->count = n;
+
+}
+
+/* build a tree from sorted keys */
+RbTree* rbBuildSorted(const uint32_t *keys, void **values, const uint32_t n) {
+
+    RbTree *ret;
+    RbBuildState state;
+    uint32_t i;
+
+    for(i = 1; i < n; i++) {
+	if(keys[i] <= keys[i - 1]) {
+	    return NULL;
+	}
+    }
+
+    ret = rbCreatePool(0);
+
+    if(ret == NULL || n == 0) {
+	return ret;
+    }
+
+    mpReserve(ret->pool, n);
+    state.nodes = mpAlloc(ret->pool);
+    for(i = 1; i < n; i++) {
+	mpAlloc(ret->pool);
+    }
+    state.stride = ret->pool->itemsize;
+    state.links = NULL;
+    state.keys = keys;
+    state.values = values;
+
+    rbBuildTree(ret, &state, n);
+
+    return ret;
+
+}
+
+/* free the calling thread's shared node pool if no tree uses it any more */
+bool rbPoolThreadFree() {
+
+    if(rbTlsRefs > 0) {
+	return false;
+    }
+
+    mpFree(rbTlsPool);
+    rbTlsPool = NULL;
+
+    return true;
+
+}
+
+/* binary search tree search (in a red-black tree) */
+RbNode* rbSearch(RbNode *root, const uint32_t key) {
+
+    RbNode *current = root;
+
+    while(current != NULL) {
+
+	if(current->key == key) {
+	    return current;
+	}
+
+	current = current->children[key > current->key];
+
+    }
+
+    return NULL;
+}
+
+/*
+ * closest key in given direction: the first key >= key (RB_ASC) or the last key <= key (RB_DESC),
+ * excluding key itself with RB_EXCL. One descent, remembering the last node that qualified
+ */
+static inline RbNode* rbBound(RbTree *tree, const uint32_t key, const int dir, const int qual) {
+
+    RbNode *current = tree->root;
+    RbNode *ret = NULL;
+
+    while(current != NULL) {
+
+	if(current->key == key && qual == RB_INCL) {
+	    return current;
+	}
+
+	/* current qualifies if it lies beyond key in our direction: remember it, look for a closer one */
+	if((dir == RB_ASC) ? (current->key > key) : (current->key < key)) {
+	    ret = current;
+	    current = current->children[dir];
+	} else {
+	    current = current->children[!dir];
+	}
+
+    }
+
+    return ret;
+
+}
+
+/* first node with key >= key */
+RbNode* rbLowerBound(RbTree *tree, const uint32_t key) {
+
+    return rbBound(tree, key, RB_ASC, RB_INCL);
+
+}
+
+/* first node with key > key */
+RbNode* rbUpperBound(RbTree *tree, const uint32_t key) {
+
+    return rbBound(tree, key, RB_ASC, RB_EXCL);
+
+}
+
+/* last node with key <= key */
+RbNode* rbFloor(RbTree *tree, const uint32_t key) {
+
+    return rbBound(tree, key, RB_DESC, RB_INCL);
+
+}
+
+/* first node with key >= key */
+RbNode* rbCeiling(RbTree *tree, const uint32_t key) {
+
+    return rbBound(tree, key, RB_ASC, RB_INCL);
+
+}
+
+/* node with the key closest to key, the lower one on a tie */
+RbNode* rbNearest(RbTree *tree, const uint32_t key) {
+
+    RbNode *floor = rbFloor(tree, key);
+    RbNode *ceiling;
+
+    if(floor != NULL && floor->key == key) {
+	return floor;
+    }
+
+    ceiling = rbCeiling(tree, key);
+
+    if(floor == NULL) {
+	return ceiling;
+    }
+
+    if(ceiling == NULL) {
+	return floor;
+    }
+
+    return (ceiling->key - key < key - floor->key) ? ceiling : floor;
+
+}
+
+/* search for key, through the hot key cache and the negative lookup filter if enabled */
+RbNode* rbLookup(RbTree *tree, const uint32_t key) {
+
+    RbNode **slot = NULL;
+    RbNode *ret;
+
+    /* the hash index is exact, nothing else to consult */
+    if(tree->hash != NULL) {
+	return rbHashGet(tree->hash, key);
+    }
+
+    if(tree->cache == NULL && tree->filter == NULL) {
+	return rbSearch(tree->root, key);
+    }
+
+    /* hot keys are in the tree: the cache goes first */
+    if(tree->cache != NULL) {
+
+	slot = rbCacheSlot(tree->cache, key);
+	ret = *slot;
+
+	if(ret != NULL && ret->key == key) {
+	    tree->cache->hits++;
+	    return ret;
+	}
+
+	tree->cache->misses++;
+
+    }
+
+    if(tree->filter != NULL && !kfBloomQuery(tree->filter->bloom, key)) {
+	tree->filter->negatives++;
+	return NULL;
+    }
+
+    ret = rbSearch(tree->root, key);
+
+    if(ret == NULL) {
+	if(tree->filter != NULL) {
+	    tree->filter->falsepositives++;
+	}
+    /* only nodes that exist are cached: insertion never makes the cache stale */
+    } else if(slot != NULL) {
+	*slot = ret;
+    }
+
+    return ret;
+
+}
+
+/* enable or resize the hot key cache */
+void rbCacheEnable(RbTree *tree, const uint32_t slots) {
+
+    uint32_t bits = 1;
+
+    /* at least two slots, so that the hash shift stays below 32 */
+    while(bits < 31 && ((uint32_t)1 << bits) < slots) {
+	bits++;
+    }
+
+    rbCacheDisable(tree);
+
+    xcalloc(tree->cache, 1, sizeof(RbCache));
+    xcalloc(tree->cache->slots, (size_t)1 << bits, sizeof(RbNode*));
+    tree->cache->shift = 32 - bits;
+
+}
+
+/* drop the hot key cache */
+void rbCacheDisable(RbTree *tree) {
+
+    if(tree->cache != NULL) {
+	free(tree->cache->slots);
+	free(tree->cache);
+	tree->cache = NULL;
+    }
+
+}
+
+/* enable or rebuild the negative lookup filter */
+void rbFilterEnable(RbTree *tree, const uint32_t bitsperkey) {
+
+    if(tree->filter == NULL) {
+	xcalloc(tree->filter, 1, sizeof(RbFilter));
+    }
+
+    tree->filter->bitsperkey = (bitsperkey == 0) ? RB_FILTER_BITS : bitsperkey;
+    rbFilterRebuild(tree);
+
+}
+
+/* drop the negative lookup filter */
+void rbFilterDisable(RbTree *tree) {
+
+    if(tree->filter != NULL) {
+	kfBloomFree(tree->filter->bloom);
+	free(tree->filter);
+	tree->filter = NULL;
+    }
+
+}
+
+/* negative lookup filter statistics */
+bool rbFilterStats(RbTree *tree, RbFilterStats *stats) {
+
+    RbFilter *filter = tree->filter;
+    uint64_t absent;
+
+    if(filter == NULL) {
+	return false;
+    }
+
+    absent = filter->negatives + filter->falsepositives;
+
+    stats->bytes = kfBloomSize(filter->bloom);
+    stats->bitsperkey = (tree->count == 0) ? 0.0 : 8.0 * stats->bytes / tree->count;
+    stats->fpr = kfBloomFpr(filter->bloom);
+    stats->measuredfpr = (absent == 0) ? 0.0 : (double)filter->falsepositives / absent;
+    stats->negatives = filter->negatives;
+    stats->falsepositives = filter->falsepositives;
+    stats->rebuilds = filter->rebuilds;
+
+    return true;
+
+}
+
+#ifdef RBT_ORDSTAT
+/* number of keys lower than key, or lower or equal with RB_INCL: sum up the left sides of every right turn */
+static inline uint32_t rbCountBelow(RbTree *tree, const uint32_t key, const int qual) {
+
+    RbNode *current = tree->root;
+    uint32_t ret = 0;
+
+    while(current != NULL) {
+
+	if(current->key < key || (current->key == key && qual == RB_INCL)) {
+	    ret += rbSize(current->children[RB_LEFT]) + 1;
+	    current = current->children[RB_RIGHT];
+	} else {
+	    current = current->children[RB_LEFT];
+	}
+
+    }
+
+    return ret;
+
+}
+
+/* number of keys lower than key */
+uint32_t rbRank(RbTree *tree, const uint32_t key) {
+
+    return rbCountBelow(tree, key, RB_EXCL);
+
+}
+
+/* node with the index-th lowest key */
+RbNode* rbSelect(RbTree *tree, const uint32_t index) {
+
+    RbNode *current = tree->root;
+    uint32_t i = index;
+
+    while(current != NULL) {
+
+	uint32_t left = rbSize(current->children[RB_LEFT]);
+
+	if(i == left) {
+	    return current;
+	}
+
+	if(i < left) {
+	    current = current->children[RB_LEFT];
+	} else {
+	    i -= left + 1;
+	    current = current->children[RB_RIGHT];
+	}
+
+    }
+
+    return NULL;
+
+}
+
+/* number of keys in range: keys below the end minus keys below the start */
+uint32_t rbCountRange(RbTree *tree, const uint32_t low, const int lowqual, const uint32_t high, const int highqual) {
+
+    uint32_t start = 0;
+    uint32_t end = tree->count;
+
+    if(lowqual != RB_INF) {
+	/* inclusive start: everything lower than low is out; exclusive: low itself too */
+	start = rbCountBelow(tree, low, (lowqual == RB_INCL) ? RB_EXCL : RB_INCL);
+    }
+
+    if(highqual != RB_INF) {
+	end = rbCountBelow(tree, high, highqual);
+    }
+
+    return (end > start) ? end - start : 0;
+
+}
+#endif /* RBT_ORDSTAT */
+
+/* leftmost (RB_LEFT) or rightmost (RB_RIGHT) node below and including node */
+static inline RbNode* rbEdge(RbNode *node, const int dir) {
+
+    if(node != NULL) {
+	while(node->children[dir] != NULL) {
+	    node = node->children[dir];
+	}
+    }
+
+    return node;
+
+}
+
+/* in-order neighbour in given direction (RB_ASC = successor, RB_DESC = predecessor), using parent links only */
+static inline RbNode* rbStep(RbNode *node, const int dir) {
+
+    RbNode *parent;
+
+    /* the nearest one below us on the far side... */
+    if(node->children[!dir] != NULL) {
+	return rbEdge(node->children[!dir], dir);
+    }
+
+    /* ...or the first ancestor we are on the near side of */
+    while((parent = rbGetParent(node)) != NULL && node == parent->children[!dir]) {
+	node = parent;
+    }
+
+    return parent;
+
+}
+
+/* number of keys, counted now if the tree was left uncounted by a split */
+uint32_t rbCount(RbTree *tree) {
+
+    RbNode *node;
+    uint32_t n = 0;
+
+    if(tree->uncounted) {
+	for(node = tree->min; node != NULL; node = rbNext(node)) {
+	    n++;
+	}
+	tree->count = n;
+	tree->uncounted = false;
+    }
+
+    return tree->count;
+
+}
+
+/* node with the lowest key */
+RbNode* rbMin(RbTree *tree) {
+
+    return tree->min;
+
+}
+
+/* node with the highest key */
+RbNode* rbMax(RbTree *tree) {
+
+    return tree->max;
+
+}
+
+/* node with the lowest key */
+RbNode* rbFirst(RbTree *tree) {
+
+    return tree->min;
+
+}
+
+/* node with the highest key */
+RbNode* rbLast(RbTree *tree) {
+
+    return tree->max;
+
+}
+
+/* in-order successor */
+RbNode* rbNext(RbNode *node) {
+
+    return (node == NULL) ? NULL : rbStep(node, RB_ASC);
+
+}
+
+/* in-order predecessor */
+RbNode* rbPrev(RbNode *node) {
+
+    return (node == NULL) ? NULL : rbStep(node, RB_DESC);
+
+}
+
+/* in-order traversal without heap allocation */
+void rbIterate(RbTree *tree, RbCallback callback, void *user, const int dir) {
+
+    rbIterateRange(tree, callback, user, dir, 0, RB_INF, 0, RB_INF);
+
+}
+
+/*
+ * in-order traversal over a range without heap allocation: the path is kept in a fixed-size array, as the tree can be
+ * no taller than RB_MAX_HEIGHT. Parent links are not used: they would take us back through nodes we are done with
+ */
+uint32_t rbIterateRange(RbTree *tree, RbCallback callback, void *user, const int dir,
+		const uint32_t low, const int lowqual, const uint32_t high, const int highqual) {
+
+    RbNode *stack[RB_MAX_HEIGHT];
+    RbNode *current, *tmp;
+    int sh = 0;
+    uint32_t nodenumber = 0;
+    bool cont = true;
+    /* start and end limits, swapped for descending order */
+    uint32_t from = (dir == RB_ASC) ? low : high;
+    uint32_t to = (dir == RB_ASC) ? high : low;
+    int fromqual = (dir == RB_ASC) ? lowqual : highqual;
+    int toqual = (dir == RB_ASC) ? highqual : lowqual;
+
+    /* the path to the first node in range: only the nodes that are in range, the first one on top */
+    current = tree->root;
+    while(current != NULL) {
+
+	if(fromqual != RB_INF && current->key == from) {
+	    if(fromqual == RB_INCL) {
+		stack[sh++] = current;
+		break;
+	    }
+	    current = current->children[!dir];
+	} else if(fromqual == RB_INF || ((dir == RB_ASC) ? (current->key > from) : (current->key < from))) {
+	    stack[sh++] = current;
+	    current = current->children[dir];
+	} else {
+	    current = current->children[!dir];
+	}
+
+    }
+
+    while(cont && sh > 0) {
+
+	current = stack[--sh];
+
+	/* past the end of range */
+	if(toqual != RB_INF) {
+	    if((dir == RB_ASC) ? (current->key > to) : (current->key < to)) {
+		break;
+	    }
+	    if(toqual == RB_EXCL && current->key == to) {
+		break;
+	    }
+	}
+
+	/* preserve the pointer first: this allows the callback to free the node if it wants that */
+	tmp = current->children[!dir];
+	if(callback == NULL) {
+	    nodenumber++;
+	} else {
+	    callback(tree, current, user, 0, 0, &cont, nodenumber++);
+	}
+
+	/* the next nodes are down the other side */
+	for(; tmp != NULL; tmp = tmp->children[dir]) {
+	    stack[sh++] = tmp;
+	}
+
+    }
+
+    return nodenumber;
+
+}
+
+/*
+ * finger search, first half: climb from the finger until an ancestor on the far side of the key bounds it from there, and
+ * return the node whose subtree holds the key (or the place to insert it). Ancestors on the near side are passed over,
+ * as the key lies beyond their whole subtree too
+ */
+static inline RbNode* rbClimb(RbNode *finger, const uint32_t key) {
+
+    RbNode *current = finger;
+    RbNode *parent;
+    int dir;
+
+    if(current->key == key) {
+	return current;
+    }
+
+    dir = (key > current->key);
+
+    while((parent = rbGetParent(current)) != NULL) {
+
+	/* we are on the parent's opposite side to dir: the parent is the bound */
+	if(parent->children[dir] != current) {
+	    if(parent->key == key) {
+		return parent;
+	    }
+	    if((parent->key > key) == dir) {
+		break;
+	    }
+	}
+
+	current = parent;
+
+    }
+
+    return current;
+
+}
+
+/* finger search, NULL finger = from the root */
+RbNode* rbSearchFrom(RbTree *tree, RbNode *finger, const uint32_t key) {
+
+    return rbSearch((finger == NULL) ? tree->root : rbClimb(finger, key), key);
+
+}
+
+/*
+ * batched search, AMAC style: up to RB_BATCH_SLOTS descents are in flight and advanced in turns, one level
+ * each, prefetching the next node of every descent - by the time a descent gets its turn again, its node
+ * is (hopefully) in cache. A finished descent hands its slot to the next key straight away
+ */
+uint32_t rbSearchBatch(RbTree *tree, const uint32_t *keys, const uint32_t count, RbNode **out) {
+
+    RbNode *current[RB_BATCH_SLOTS];
+    uint32_t index[RB_BATCH_SLOTS];
+    uint32_t next = 0, live = 0, found = 0;
+    int i;
+
+    /* fill the slots */
+    for(i = 0; i < RB_BATCH_SLOTS; i++) {
+	current[i] = tree->root;
+	if(next < count) {
+	    index[i] = next++;
+	    live++;
+	} else {
+	    index[i] = UINT32_MAX;
+	}
+    }
+
+    while(live > 0) {
+
+	for(i = 0; i < RB_BATCH_SLOTS; i++) {
+
+	    RbNode *node = current[i];
+	    uint32_t key;
+
+	    if(index[i] == UINT32_MAX) {
+		continue;
+	    }
+
+	    key = keys[index[i]];
+
+	    /* this one is done: report it and take the next key, or retire the slot */
+	    if(node == NULL || node->key == key) {
+		out[index[i]] = node;
+		found += (node != NULL);
+		if(next < count) {
+		    index[i] = next++;
+		    current[i] = tree->root;
+		} else {
+		    index[i] = UINT32_MAX;
+		    live--;
+		}
+		continue;
+	    }
+
+	    node = node->children[key > node->key];
+	    __builtin_prefetch(node);
+	    current[i] = node;
+
+	}
+
+    }
+
+    return found;
+
+}
+
+/* fix red->red violations upwards from a red node, return true if the root had to be blackened (one more black level) */
+static inline bool rbFixRed(RbTree *tree, RbNode *current) {
+
+    bool grown;
+
+    /* travel upwards and correct red->red violations */
+    while(rbRed(current) && rbRed(rbGetParent(current))) {
+
+	RbNode *parent = rbGetParent(current);
+	RbNode *grandparent = rbGetParent(parent);
+
+	/* parent's direction */
+	int dir = rbDir(parent);
+	int otherdir = !dir;
+
+	/* knowing the parent's direction, uncle is the other guy */
+	RbNode *uncle = grandparent->children[otherdir];
+
+	/* red uncle: recolour, move up */
+	if(rbRed(uncle)) {
+	    rbSetRed(grandparent, true);
+	    rbSetRed(parent, false);
+	    rbSetRed(uncle, false);
+	    current = grandparent;
+	/* black uncle - rotate and recolour */
+	} else {
+	    /* current is in the opposite direction to parent - there will be two rotations */
+	    if(current == parent->children[otherdir]) {
+		    rbRotate(tree, parent, dir);
+		    current = parent;
+		    parent = rbGetParent(current);
+	    }
+
+	    /* rotate */
+	    rbRotate(tree, grandparent, otherdir);
+
+	    /* recolour, move up */
+	    rbSetRed(parent, false);
+	    rbSetRed(grandparent, true);
+	    current = parent;
+
+	}
+
+    }
+
+    grown = rbGetRed(tree->root);
+    rbSetRed(tree->root, false);
+
+    return grown;
+
+}
+
+/* fix up the tree after a BST insertion of given node, return the node */
+static inline RbNode* rbInsertFixup(RbTree *tree, RbNode *ret) {
+
+    /* empty tree, new root */
+    if(tree->root == NULL) {
+	tree->root = ret;
+	rbSetRed(tree->root, false);
+	return ret;
+    }
+
+    /* the new node is coloured red only on creation - if exists, no change of colour, so no violations */
+    rbFixRed(tree, ret);
+
+    /* return new node */
+    return ret;
+
+}
+
+/* insert a key into the tree, return the newly inserted node, or existing node if key exists */
+RbNode* rbInsert(RbTree *tree, const uint32_t key) {
+
+    /* intrusive trees do not allocate */
+    if(tree->flags & RB_INTRUSIVE) {
+	return NULL;
+    }
+
+    return rbInsertFixup(tree, bstInsert(tree, tree->root, key, NULL));
+
+}
+
+/* insert a key next to a hint node, return the newly inserted node, or existing node if key exists */
+RbNode* rbInsertHint(RbTree *tree, RbNode *hint, const uint32_t key) {
+
+    RbNode *neighbour;
+    int dir;
+
+    if(tree->flags & RB_INTRUSIVE) {
+	return NULL;
+    }
+
+    if(hint == NULL) {
+	return rbInsert(tree, key);
+    }
+
+    if(hint->key == key) {
+	return hint;
+    }
+
+    /* the hint's in-order neighbour on the key's side - the ends of the tree are known without climbing */
+    dir = (key > hint->key);
+    if(hint == ((dir == RB_RIGHT) ? tree->max : tree->min)) {
+	neighbour = NULL;
+    } else {
+	neighbour = rbStep(hint, !dir);
+    }
+
+    if(neighbour != NULL && neighbour->key == key) {
+	return neighbour;
+    }
+
+    /* key falls between the two: whichever has a free slot facing the other takes the new node */
+    if(neighbour == NULL || (key < neighbour->key) == dir) {
+	return rbInsertFixup(tree, bstInsert(tree, (hint->children[dir] == NULL) ? hint : neighbour, key, NULL));
+    }
+
+    /* wrong hint: the key is further out, but likely still close */
+    return rbInsertFixup(tree, bstInsert(tree, rbClimb(hint, key), key, NULL));
+
+}
+
+/* insert a caller-provided node with its key set into an intrusive tree, return the node, or existing node if key exists */
+RbNode* rbInsertNode(RbTree *tree, RbNode *node) {
+
+    if(!(tree->flags & RB_INTRUSIVE) || node == NULL) {
+	return NULL;
+    }
+
+    return rbInsertFixup(tree, bstInsert(tree, tree->root, node->key, node));
+
+}
+
+
+/* binary search tree deletion with red-black tree fixup combined - unlinks the node, does not free it */
+static void rbUnlinkNode(RbTree *tree, RbNode *node) {
+
+    /* unbalanced parent, happy children, yay! */
+    RbNode *ubparent = NULL;
+    int dir = 0;
+
+    if(node != NULL) {
+
+	/* the lowest and highest nodes have one child at most, so their new replacements are one step away */
+	if(node == tree->min) {
+	    tree->min = rbStep(node, RB_ASC);
+	}
+	if(node == tree->max) {
+	    tree->max = rbStep(node, RB_DESC);
+	}
+
+	rbForgetNode(tree, node);
+
+	/*
+	 * if the node to be deleted is has two children, we find the successor and swap places with it,
+	 * so that the node to delete ends up where the successor was: one child at most
+	 */
+	if(node->children[RB_LEFT] != NULL && node->children[RB_RIGHT] != NULL) {
+
+	    /* right first */
+	    RbNode *successor = node->children[RB_RIGHT];
+	    while(successor->children[RB_LEFT] != NULL) {
+		/* then left all the way */
+		successor = successor->children[RB_LEFT];
+	    }
+
+	    rbSwapSuccessor(tree, node, successor);
+
+	}
+	
+	/* at this point the node we are working with can ony have one child or zero children */
+
+	/* if node has one child, this leads us to it. if it has none, it will point to NULL */
+	RbNode *promoted = node->children[node->children[RB_LEFT] == NULL];
+
+	/* fix parent link - or root link */
+	if(rbGetParent(node) == NULL) {
+	    tree->root = promoted;
+	} else {
+	    dir = rbDir(node);
+	    rbGetParent(node)->children[dir] = promoted;
+	}
+
+	/* fix promoted node's parent link */
+	if(promoted != NULL) {
+	    rbSetParent(promoted, rbGetParent(node));
+	}
+
+#ifdef RBT_ORDSTAT
+	/* one node less in every subtree on the way up */
+	for(RbNode *up = rbGetParent(node); up != NULL; up = rbGetParent(up)) {
+	    up->size--;
+	}
+#endif /* RBT_ORDSTAT */
+
+	/* the node is out of the tree, tree->count - 1 being the count after this deletion */
+	rbFilterStale(tree, 1, tree->count - 1);
+	
+	/* if node and node's child differ in colour, promoted node needs to be black to keep the black height, and we are done */
+	if(rbGetRed(node) != rbRed(promoted)) {
+	    if(!rbGetRed(node)) {
+		rbSetRed(promoted, false);
+	    }
+	    tree->count--;
+	    return;
+	} else {
+	    /* our disturbed node is removed, and instead of "double black" or other such nonsense, we track its parent and direction towards it */
+	    ubparent = rbGetParent(node);
+	    tree->count--;
+	    if(ubparent != NULL) {
+		ubparent->children[dir] = NULL;
+	    }
+	}
+
+	/* keep going as long as we have some rebalancing to do */
+	while(ubparent != NULL ) {
+
+	    int otherdir = !dir;
+	    RbNode *ubsibling = ubparent->children[otherdir];
+
+	    /* case 1: parent black, sibling red... the tree was balanced before, so if sibling red, parent must be black, recolour and continue */
+	    if(rbRed(ubsibling)) {
+
+		rbRotate(tree, ubparent, dir);
+		rbSetRed(ubparent, true);
+		rbSetRed(ubsibling, false);
+
+	    /* case 2: sibling black (because not red, above), has red child on opposite side to unbalanced node: rotate, recolour, done */
+	    } else if(rbRed(ubsibling->children[otherdir])) {
+
+		rbSetRed(ubsibling->children[otherdir], false);
+		rbSetRed(ubsibling, rbGetRed(ubparent));
+		rbSetRed(ubparent, false);
+		rbRotate(tree, ubparent, dir);
+		return;
+
+	    /* case 3: sibling black, has red child on same side as deleted node: recolour, rotate and we turn into case 1 */
+	    } else if(rbRed(ubsibling->children[dir])) {
+
+		rbSetRed(ubsibling->children[dir], false);
+		rbSetRed(ubsibling, true);
+		rbRotate(tree, ubsibling, otherdir);
+
+	    /* case 4: red parent: recolour, done */
+	    } else if(rbGetRed(ubparent)) {
+
+		rbSetRed(ubparent, false);
+		rbSetRed(ubsibling, true);
+		return;
+
+	    /* case 5: parent and sibling black - mark sibling red and rebalance from parent */
+	    } else {
+
+		rbSetRed(ubsibling, true);
+		if(rbGetParent(ubparent) != NULL) {
+		    /* no need to do this every time */
+		    dir = rbDir(ubparent);
+		}
+		ubparent = rbGetParent(ubparent);
+
+	    }
+	
+	}
+
+    }
+
+}
+
+/* delete a node from red-black tree, freeing it unless the tree is intrusive */
+void rbDeleteNode(RbTree *tree, RbNode *node) {
+
+    if(node != NULL) {
+	rbUnlinkNode(tree, node);
+	if(!(tree->flags & RB_INTRUSIVE)) {
+	    rbDestroyNode(tree, node);
+	}
+    }
+
+}
+
+/* unlink a node from an intrusive tree and rebalance, the node is returned to the caller with its links cleared */
+RbNode* rbRemoveNode(RbTree *tree, RbNode *node) {
+
+    if(!(tree->flags & RB_INTRUSIVE) || node == NULL) {
+	return NULL;
+    }
+
+    rbUnlinkNode(tree, node);
+    node->children[0] = node->children[1] = NULL;
+    rbInitParent(node, NULL, false);
+
+    return node;
+
+}
+
+/* unlink the lowest or highest node, the node is returned to the caller with its links cleared */
+static inline RbNode* rbPop(RbTree *tree, RbNode *node) {
+
+    if(node != NULL) {
+	rbUnlinkNode(tree, node);
+	node->children[0] = node->children[1] = NULL;
+	rbInitParent(node, NULL, false);
+    }
+
+    return node;
+
+}
+
+/* unlink the node with the lowest key */
+RbNode* rbPopMin(RbTree *tree) {
+
+    return rbPop(tree, tree->min);
+
+}
+
+/* unlink the node with the highest key */
+RbNode* rbPopMax(RbTree *tree) {
+
+    return rbPop(tree, tree->max);
+
+}
+
+/* release a popped node */
+void rbFreeNode(RbTree *tree, RbNode *node) {
+
+    if(node != NULL && !(tree->flags & RB_INTRUSIVE)) {
+	rbDestroyNode(tree, node);
+    }
+
+}
+
+/* delete the node with the given key from red-black tree */
+void rbDeleteKey(RbTree *tree, const uint32_t key) {
+
+    rbDeleteNode(tree, (tree->hash != NULL) ? rbHashGet(tree->hash, key) : rbSearch(tree->root, key));
+
+}
+
+/* number of black nodes on any path from node down to a leaf, node included */
+static inline int rbBlackHeight(RbNode *node) {
+
+    int bh = 0;
+
+    for(; node != NULL; node = node->children[RB_LEFT]) {
+	bh += !rbGetRed(node);
+    }
+
+    return bh;
+
+}
+
+/* node count for heuristics: an uncounted tree of black height bh has between 2^bh - 1 and 4^bh - 1 nodes, say 2^1.5bh */
+static inline uint64_t rbCountHint(RbTree *tree) {
+
+    int bh;
+
+    if(!tree->uncounted) {
+	return tree->count;
+    }
+
+    bh = rbBlackHeight(tree->root);
+    return (uint64_t)1 << (bh + bh / 2);
+
+}
+
+/*
+ * join two detached subtrees of given black heights, all keys in low below pivot's key, all keys in high above it, with
+ * the pivot between them: the pivot is hung red off the taller tree's near spine, at the shorter tree's black height,
+ * and red->red is fixed from there. O(1 + difference in black height). Returns the new root, *bh = its black height
+ */
+static RbNode* rbJoinNodes(RbNode *low, int lowbh, RbNode *pivot, RbNode *high, int highbh, int *bh) {
+
+    RbTree part;
+    RbNode *tall, *shrt, *parent = NULL, *current;
+    int dir, tallbh, shortbh;
+
+    /* black roots, so that the red pivot never ends up with a red parent at the top */
+    if(rbRed(low)) {
+	rbSetRed(low, false);
+	lowbh++;
+    }
+    if(rbRed(high)) {
+	rbSetRed(high, false);
+	highbh++;
+    }
+
+    /* same black height: the pivot simply goes on top */
+    if(lowbh == highbh) {
+	pivot->children[RB_LEFT] = low;
+	pivot->children[RB_RIGHT] = high;
+	rbInitParent(pivot, NULL, false);
+	if(low != NULL) {
+	    rbSetParent(low, pivot);
+	}
+	if(high != NULL) {
+	    rbSetParent(high, pivot);
+	}
+#ifdef RBT_ORDSTAT
+	pivot->size = 1 + rbSize(low) + rbSize(high);
+#endif /* RBT_ORDSTAT */
+	*bh = lowbh + 1;
+	return pivot;
+    }
+
+    /* walk down the taller tree's spine facing the other tree (right spine of low, left spine of high) */
+    dir = (lowbh > highbh);
+    tall = dir ? low : high;
+    tallbh = dir ? lowbh : highbh;
+    shrt = dir ? high : low;
+    shortbh = dir ? highbh : lowbh;
+
+    /* ...to the first black node (or leaf) as tall as the shorter tree */
+    for(current = tall; tallbh > shortbh || rbRed(current); current = current->children[dir]) {
+	tallbh -= !rbGetRed(current);
+	parent = current;
+    }
+
+    /* the pivot takes its place, with it on the taller tree's side and the shorter tree on the other */
+    pivot->children[!dir] = current;
+    pivot->children[dir] = shrt;
+    rbInitParent(pivot, parent, true);
+    parent->children[dir] = pivot;
+    if(current != NULL) {
+	rbSetParent(current, pivot);
+    }
+    if(shrt != NULL) {
+	rbSetParent(shrt, pivot);
+    }
+
+#ifdef RBT_ORDSTAT
+    pivot->size = 1 + rbSize(current) + rbSize(shrt);
+    for(; parent != NULL; parent = rbGetParent(parent)) {
+	parent->size += 1 + rbSize(shrt);
+    }
+#endif /* RBT_ORDSTAT */
+
+    part.root = tall;
+    *bh = (dir ? lowbh : highbh) + rbFixRed(&part, pivot);
+
+    return part.root;
+
+}
+
+/*
+ * split a detached subtree of given black height in two: nodes with keys below key (and the node with key itself if
+ * eqlow) go to *low, the rest to *high - or, if match is not NULL, the node with key goes to *match (NULL if none).
+ * Each node on the search path is the pivot of one join, and the joins on either side are of growing black height,
+ * so the whole split is O(log n). The resulting roots may be red
+ */
+static void rbSplitNodes(RbNode *root, const int bh, const uint32_t key, const bool eqlow, RbNode **match,
+			RbNode **low, int *lowbh, RbNode **high, int *highbh) {
+
+    RbNode *left, *right, *part = NULL;
+    int childbh, partbh = 0;
+
+    if(root == NULL) {
+	*low = *high = NULL;
+	*lowbh = *highbh = 0;
+	if(match != NULL) {
+	    *match = NULL;
+	}
+	return;
+    }
+
+    left = root->children[RB_LEFT];
+    right = root->children[RB_RIGHT];
+    childbh = bh - !rbGetRed(root);
+
+    if(left != NULL) {
+	rbSetParent(left, NULL);
+    }
+    if(right != NULL) {
+	rbSetParent(right, NULL);
+    }
+
+    if(match != NULL && root->key == key) {
+	root->children[RB_LEFT] = root->children[RB_RIGHT] = NULL;
+	*match = root;
+	*low = left;
+	*high = right;
+	*lowbh = *highbh = childbh;
+	return;
+    }
+
+    if(root->key < key || (eqlow && root->key == key)) {
+	/* root and its left subtree go low, the right subtree is split further unless the split is right here */
+	if(root->key == key) {
+	    *high = right;
+	    *highbh = childbh;
+	} else {
+	    rbSplitNodes(right, childbh, key, eqlow, match, &part, &partbh, high, highbh);
+	}
+	*low = rbJoinNodes(left, childbh, root, part, partbh, lowbh);
+    } else {
+	/* root and its right subtree go high */
+	if(root->key == key) {
+	    *low = left;
+	    *lowbh = childbh;
+	} else {
+	    rbSplitNodes(left, childbh, key, eqlow, match, low, lowbh, &part, &partbh);
+	}
+	*high = rbJoinNodes(part, partbh, root, right, childbh, highbh);
+    }
+
+}
+
+/* join two detached subtrees, all keys in low below all keys in high, with the lowest node of high as the pivot */
+static RbNode* rbConcatNodes(RbNode *low, int lowbh, RbNode *high, int highbh, int *bh) {
+
+    RbTree part;
+    RbNode *pivot;
+
+    if(high == NULL) {
+	*bh = lowbh;
+	return low;
+    }
+
+    if(low == NULL) {
+	*bh = highbh;
+	return high;
+    }
+
+    /* the pivot leaves high like any other node: a scratch tree container without cache, index or filter */
+    memset(&part, 0, sizeof(part));
+    part.root = high;
+    part.min = pivot = rbEdge(high, RB_ASC);
+    part.count = 1;
+    rbUnlinkNode(&part, pivot);
+
+    return rbJoinNodes(low, lowbh, pivot, part.root, rbBlackHeight(part.root), bh);
+
+}
+
+/* a node out of the tree for good: clear its links, hand it to the callback, free it unless the tree is intrusive */
+static inline void rbDropNode(RbTree *tree, RbNode *node, void (*freeCallback) (RbNode *node)) {
+
+    node->children[0] = node->children[1] = NULL;
+    rbInitParent(node, NULL, false);
+
+    if(freeCallback != NULL) {
+	freeCallback(node);
+    }
+
+    if(!(tree->flags & RB_INTRUSIVE)) {
+	rbDestroyNode(tree, node);
+    }
+
+}
+
+/* delete a range of keys */
+uint32_t rbDeleteRange(RbTree *tree, const uint32_t low, const int lowqual, const uint32_t high, const int highqual,
+			void (*freeCallback) (RbNode *node)) {
+
+    /* one pending right subtree per level at most, plus the node at hand */
+    RbNode *stack[RB_MAX_HEIGHT + 1];
+    RbNode *below = NULL, *range = tree->root, *above = NULL, *first, *node;
+    int bh, belowbh = 0, rangebh, abovebh = 0, top = 0;
+    uint32_t removed = 0, i;
+
+    if(tree->root == NULL) {
+	return 0;
+    }
+
+    /* an empty range leaves the tree as it is */
+    if(lowqual != RB_INF && highqual != RB_INF && (low > high || (low == high && (lowqual == RB_EXCL || highqual == RB_EXCL)))) {
+	return 0;
+    }
+
+    /* a few keys are cheaper to delete one by one than to split off: walk up to RB_RANGE_SPLIT of them to find out */
+    first = (lowqual == RB_INF) ? tree->min : rbBound(tree, low, RB_ASC, lowqual);
+    for(node = first; node != NULL && removed < RB_RANGE_SPLIT; node = rbNext(node)) {
+	if(highqual != RB_INF && (node->key > high || (node->key == high && highqual == RB_EXCL))) {
+	    break;
+	}
+	removed++;
+    }
+
+    if(removed < RB_RANGE_SPLIT) {
+	/* nodes are relinked, not copied, so the next node survives the deletion */
+	for(i = 0; i < removed; i++) {
+	    node = first;
+	    first = rbNext(node);
+	    rbUnlinkNode(tree, node);
+	    rbDropNode(tree, node, freeCallback);
+	}
+	return removed;
+    }
+
+    removed = 0;
+
+    /* cut out the range: everything below it, then everything above it */
+    rangebh = rbBlackHeight(tree->root);
+    if(lowqual != RB_INF) {
+	rbSplitNodes(tree->root, rangebh, low, lowqual == RB_EXCL, NULL, &below, &belowbh, &range, &rangebh);
+    }
+    if(highqual != RB_INF) {
+	rbSplitNodes(range, rangebh, high, highqual == RB_INCL, NULL, &range, &rangebh, &above, &abovebh);
+    }
+
+    /* and put the rest back together */
+    tree->root = rbConcatNodes(below, belowbh, above, abovebh, &bh);
+    if(tree->root != NULL) {
+	rbSetRed(tree->root, false);
+    }
+    tree->min = (tree->root == NULL) ? NULL : rbEdge(tree->root, RB_ASC);
+    tree->max = (tree->root == NULL) ? NULL : rbEdge(tree->root, RB_DESC);
+
+    /* depth-first over the cut-off subtree: children are taken off each node before it goes, so it is never revisited */
+    if(range != NULL) {
+	stack[top++] = range;
+    }
+
+    while(top > 0) {
+
+	node = stack[--top];
+
+	if(node->children[RB_RIGHT] != NULL) {
+	    stack[top++] = node->children[RB_RIGHT];
+	}
+	if(node->children[RB_LEFT] != NULL) {
+	    stack[top++] = node->children[RB_LEFT];
+	}
+
+	rbForgetNode(tree, node);
+	rbDropNode(tree, node, freeCallback);
+	removed++;
+
+    }
+
+    tree->count -= removed;
+
+    rbFilterStale(tree, removed, tree->count);
+
+    return removed;
+
+}
+
+/* the tree holds no nodes any more: reset the container, empty the cache, the filter and the hash index */
+static void rbClear(RbTree *tree) {
+
+    tree->root = NULL;
+    tree->min = tree->max = NULL;
+    tree->count = 0;
+    tree->uncounted = false;
+
+    if(tree->cache != NULL) {
+	memset(tree->cache->slots, 0, ((size_t)1 << (32 - tree->cache->shift)) * sizeof(RbNode*));
+    }
+
+    if(tree->filter != NULL) {
+	kfBloomClear(tree->filter->bloom);
+	tree->filter->stale = 0;
+    }
+
+    if(tree->hash != NULL) {
+	memset(tree->hash->slots, 0, ((size_t)tree->hash->mask + 1) * sizeof(RbHashSlot));
+    }
+
+}
+
+/* an empty tree like the given one: same flags and values, nodes from the same allocator, same size cache and hash index */
+static RbTree* rbCreateAlike(RbTree *tree) {
+
+    RbTree *ret = rbCreate();
+
+    ret->flags = tree->flags;
+    ret->valuesize = tree->valuesize;
+    ret->nodesize = tree->nodesize;
+    ret->freeCallback = tree->freeCallback;
+
+    if(tree->flags & RB_POOL_TLS) {
+	rbTlsRefs++;
+	ret->pool = tree->pool;
+    } else if(tree->pool != NULL) {
+	ret->pool = mpShare(tree->pool);
+    }
+
+    /* big enough for any part of the tree, so it never has to grow while nodes move in */
+    if(tree->hash != NULL) {
+	ret->hash = rbHashCreate(32 - tree->hash->shift);
+    }
+
+    if(tree->cache != NULL) {
+	rbCacheEnable(ret, (uint32_t)1 << (32 - tree->cache->shift));
+    }
+
+    return ret;
+
+}
+
+/* nodes can move from one tree into another if the trees are alike and the receiving one can release them */
+static inline bool rbAlike(RbTree *to, RbTree *from) {
+
+    if(to == from || to->flags != from->flags || to->nodesize != from->nodesize || to->valuesize != from->valuesize
+		|| to->freeCallback != from->freeCallback) {
+	return false;
+    }
+
+    /* same allocator, or a private pool nobody else uses, which can be taken over */
+    return to->pool == from->pool || (!(to->flags & RB_POOL_TLS) && from->pool->users == 1);
+
+}
+
+/* add n nodes moved in from another tree, from first to the highest one, to the hash index and the filter */
+static void rbIndexFrom(RbTree *tree, RbNode *first, const uint32_t n) {
+
+    RbNode *node;
+    const bool rebuild = tree->filter != NULL && tree->filter->bloom->count + n > tree->filter->capacity;
+
+    if(tree->hash != NULL) {
+	while(tree->count > (tree->hash->mask + 1) / 2 && tree->hash->shift > 1) {
+	    rbHashGrow(tree);
+	}
+    }
+
+    if(tree->hash != NULL || (tree->filter != NULL && !rebuild)) {
+	for(node = first; node != NULL; node = rbNext(node)) {
+	    if(tree->hash != NULL) {
+		rbHashAdd(tree->hash, node);
+	    }
+	    if(tree->filter != NULL && !rebuild) {
+		kfBloomAdd(tree->filter->bloom, node->key);
+	    }
+	}
+    }
+
+    if(rebuild) {
+	rbFilterRebuild(tree);
+    }
+
+}
+
+/* join high into low, with a pivot node between them or without (the lowest node of high becomes the pivot) */
+static RbTree* rbJoinTrees(RbTree *low, RbNode *pivot, RbTree *high) {
+
+    RbNode *first = (pivot != NULL) ? pivot : high->min;
+    uint32_t added;
+    int bh;
+
+    /* indexing walks the keys joined in anyway, and keeps the tree counted */
+    if(low->hash != NULL || low->filter != NULL) {
+	rbCount(high);
+    }
+
+    added = high->count + (pivot != NULL);
+
+    if(low->pool != high->pool) {
+	mpMerge(low->pool, high->pool);
+    }
+
+    if(pivot != NULL) {
+	low->root = rbJoinNodes(low->root, rbBlackHeight(low->root), pivot, high->root, rbBlackHeight(high->root), &bh);
+    } else {
+	low->root = rbConcatNodes(low->root, rbBlackHeight(low->root), high->root, rbBlackHeight(high->root), &bh);
+    }
+
+    if(low->root != NULL) {
+	rbSetRed(low->root, false);
+    }
+
+    if(low->min == NULL) {
+	low->min = first;
+    }
+    if(high->max != NULL) {
+	low->max = high->max;
+    } else if(pivot != NULL) {
+	low->max = pivot;
+    }
+
+    low->count += added;
+    low->uncounted = low->uncounted || high->uncounted;
+    rbIndexFrom(low, first, added);
+
+    /* the cache, filter and hash index of the low tree are still good for its old nodes, high's are all stale */
+    rbClear(high);
+
+    return low;
+
+}
+
+/* join two trees around a key */
+RbTree* rbJoin(RbTree *low, const uint32_t key, RbTree *high) {
+
+    if((low->flags & RB_INTRUSIVE) || !rbAlike(low, high)
+		|| (low->max != NULL && low->max->key >= key) || (high->min != NULL && high->min->key <= key)) {
+	return NULL;
+    }
+
+    return rbJoinTrees(low, rbCreateNode(low, NULL, key), high);
+
+}
+
+/* join two trees */
+RbTree* rbConcat(RbTree *low, RbTree *high) {
+
+    if((low->flags & RB_INTRUSIVE) || !rbAlike(low, high) || (low->max != NULL && high->min != NULL && low->max->key >= high->min->key)) {
+	return NULL;
+    }
+
+    return rbJoinTrees(low, NULL, high);
+
+}
+
+/* split a tree in two at a key */
+void rbSplit(RbTree *tree, const uint32_t key, RbTree **low, RbTree **high) {
+
+    RbTree *hi = rbCreateAlike(tree);
+    RbTree *small = hi, *big = tree;
+    RbNode *node;
+    int lowbh, highbh;
+
+    rbSplitNodes(tree->root, rbBlackHeight(tree->root), key, false, NULL, &tree->root, &lowbh, &hi->root, &highbh);
+
+    if(tree->root != NULL) {
+	rbSetRed(tree->root, false);
+    }
+
+    if(hi->root != NULL) {
+	rbSetRed(hi->root, false);
+	hi->min = rbEdge(hi->root, RB_ASC);
+	hi->max = tree->max;
+    }
+
+    if(tree->root != NULL) {
+	tree->max = rbEdge(tree->root, RB_DESC);
+    } else {
+	tree->min = tree->max = NULL;
+    }
+
+#ifdef RBT_ORDSTAT
+    hi->count = rbSize(hi->root);
+    tree->count -= hi->count;
+#else
+    /* with one part empty, the other keeps the count */
+    if(tree->root == NULL) {
+	hi->count = tree->count;
+	hi->uncounted = tree->uncounted;
+	tree->count = 0;
+	tree->uncounted = false;
+    } else if(hi->root != NULL) {
+	tree->uncounted = hi->uncounted = true;
+    }
+#endif /* RBT_ORDSTAT */
+
+    /*
+     * the hash index and filter must lose the keys of one part and take in the other's: the smaller part is walked for
+     * that, which counts it, and the bigger part keeps what the tree had - with stale keys in the filter
+     */
+    if(tree->root == NULL) {
+	small = tree;
+	big = hi;
+    } else if(hi->root != NULL && (tree->hash != NULL || tree->filter != NULL)) {
+#ifdef RBT_ORDSTAT
+	if(tree->count < hi->count) {
+	    small = tree;
+	    big = hi;
+	}
+#else
+	/* walk both parts from their far ends towards the split, until the smaller one runs out */
+	RbNode *up = tree->min, *down = hi->max;
+	uint32_t n = 0;
+
+	for(; up != NULL && down != NULL; up = rbNext(up), down = rbPrev(down)) {
+	    n++;
+	}
+
+	if(up == NULL) {
+	    small = tree;
+	    big = hi;
+	}
+	big->count = tree->count - n;
+	small->count = n;
+	tree->uncounted = hi->uncounted = false;
+#endif /* RBT_ORDSTAT */
+    }
+
+    /* the bigger part takes over the tree's hash index and filter */
+    if(big != tree) {
+	RbHash *hash = tree->hash;
+	tree->hash = hi->hash;
+	hi->hash = hash;
+	hi->filter = tree->filter;
+	tree->filter = NULL;
+    }
+
+    if(small->root != NULL) {
+	if(big->hash != NULL) {
+	    for(node = small->min; node != NULL; node = rbNext(node)) {
+		rbHashRemove(big->hash, node);
+		rbHashAdd(small->hash, node);
+	    }
+	}
+	if(big->filter != NULL) {
+	    rbFilterStale(big, small->count, big->count);
+	}
+    }
+
+    if(big->filter != NULL) {
+	rbFilterEnable(small, big->filter->bitsperkey);
+    }
+
+    /* moved nodes are no longer in the tree's cache */
+    if(tree->cache != NULL) {
+	memset(tree->cache->slots, 0, ((size_t)1 << (32 - tree->cache->shift)) * sizeof(RbNode*));
+    }
+
+    *low = tree;
+    *high = hi;
+
+}
+
+/* set operations */
+#define RB_SET_UNION		0
+#define RB_SET_INTERSECT	1
+#define RB_SET_DIFFERENCE	2
+
+/* a set operation on two detached subtrees, one fork-join task: the result, and the nodes to free, are handed back */
+typedef struct {
+    TPool *pool;
+    RbNode *a;
+    RbNode *b;
+    int abh;
+    int bbh;
+    int op;
+    int forks; /* levels from here down that still fork */
+    RbNode *result;
+    int resultbh;
+    RbNode *discard; /* subtrees to free, chained through the parent links of their roots */
+    RbNode *discardtail;
+    uint32_t matches; /* keys found in both */
+} RbSetJob;
+
+/* a subtree the result leaves out */
+static inline void rbSetDiscard(RbSetJob *job, RbNode *root) {
+
+    if(root != NULL) {
+	rbSetParent(root, job->discard);
+	if(job->discard == NULL) {
+	    job->discardtail = root;
+	}
+	job->discard = root;
+    }
+
+}
+
+/* set operation on a's and b's subtrees: b's root is the pivot, a is split around its key, and the two halves of both
+ * are dealt with separately - the right ones on the thread pool, while forking is still worth it - then joined back */
+static void rbSetRun(void *arg) {
+
+    RbSetJob *job = arg;
+    RbSetJob left, right;
+    TpTask task;
+    RbNode *pivot = job->b, *match, *keep;
+    RbSetJob *part;
+    int i;
+
+    job->discard = job->discardtail = NULL;
+    job->matches = 0;
+
+    /* one side empty: the other one is the result, or goes too */
+    if(job->a == NULL || job->b == NULL) {
+	if(job->b == NULL && job->op != RB_SET_INTERSECT) {
+	    job->result = job->a;
+	    job->resultbh = job->abh;
+	} else if(job->a == NULL && job->op == RB_SET_UNION) {
+	    job->result = job->b;
+	    job->resultbh = job->bbh;
+	} else {
+	    rbSetDiscard(job, job->a);
+	    rbSetDiscard(job, job->b);
+	    job->result = NULL;
+	    job->resultbh = 0;
+	}
+	return;
+    }
+
+    left = right = *job;
+    left.forks = right.forks = job->forks - 1;
+    left.b = pivot->children[RB_LEFT];
+    right.b = pivot->children[RB_RIGHT];
+    left.bbh = right.bbh = job->bbh - !rbGetRed(pivot);
+
+    if(left.b != NULL) {
+	rbSetParent(left.b, NULL);
+    }
+    if(right.b != NULL) {
+	rbSetParent(right.b, NULL);
+    }
+    pivot->children[RB_LEFT] = pivot->children[RB_RIGHT] = NULL;
+
+    rbSplitNodes(job->a, job->abh, pivot->key, false, &match, &left.a, &left.abh, &right.a, &right.abh);
+
+    if(job->forks > 0) {
+	tpSubmit(job->pool, &task, rbSetRun, &right);
+	rbSetRun(&left);
+	tpWait(job->pool, &task);
+    } else {
+	rbSetRun(&left);
+	rbSetRun(&right);
+    }
+
+    /* collect what the halves left out */
+    job->matches = left.matches + right.matches + (match != NULL);
+    for(i = 0; i < 2; i++) {
+	part = (i == 0) ? &left : &right;
+	if(part->discard != NULL) {
+	    rbSetParent(part->discardtail, job->discard);
+	    if(job->discard == NULL) {
+		job->discardtail = part->discardtail;
+	    }
+	    job->discard = part->discard;
+	}
+    }
+
+    /* of a key in both trees, a's node is kept */
+    if(job->op == RB_SET_UNION) {
+	keep = (match != NULL) ? match : pivot;
+    } else if(job->op == RB_SET_INTERSECT) {
+	keep = match;
+    } else {
+	keep = NULL;
+    }
+
+    if(keep != pivot) {
+	rbSetDiscard(job, pivot);
+    }
+    if(match != NULL && keep != match) {
+	rbSetDiscard(job, match);
+    }
+
+    if(keep != NULL) {
+	job->result = rbJoinNodes(left.result, left.resultbh, keep, right.result, right.resultbh, &job->resultbh);
+    } else {
+	job->result = rbConcatNodes(left.result, left.resultbh, right.result, right.resultbh, &job->resultbh);
+    }
+
+}
+
+/*
+ * the thread pool for set operations, started on first use - NULL if set to one thread. The caller is one more user of
+ * the pool, let go with tpFree(), so that rbSetThreads() can retire it while the operation is still running
+ */
+static TPool* rbGetThreadPool() {
+
+    TPool *ret = NULL;
+
+    pthread_mutex_lock(&rbThreadLock);
+    if(rbThreadPool == NULL && rbThreads != 1) {
+	rbThreadPool = tpCreate(rbThreads);
+    }
+    if(rbThreadPool != NULL) {
+	ret = tpShare(rbThreadPool);
+    }
+    pthread_mutex_unlock(&rbThreadLock);
+
+    return ret;
+
+}
+
+/* run a set operation in place: the result is left in a, b is left empty */
+static RbTree* rbSetOperation(RbTree *a, RbTree *b, const int op) {
+
+    RbNode *stack[RB_MAX_HEIGHT + 1];
+    RbSetJob job;
+    RbNode *root, *next, *node;
+    uint32_t count;
+    uint64_t total;
+    bool rebuild = false;
+    int top;
+
+    if(!rbAlike(a, b)) {
+	return NULL;
+    }
+
+    /* indexing walks b's keys anyway, and keeps the tree counted */
+    if(op == RB_SET_UNION && (a->hash != NULL || a->filter != NULL)) {
+	rbCount(b);
+    }
+
+    count = a->count;
+    total = (uint64_t)a->count + b->count;
+
+    if(a->pool != b->pool) {
+	mpMerge(a->pool, b->pool);
+    }
+
+    /* a union takes b's keys into a's hash index and filter up front, while they are easy to find - duplicates excepted */
+    if(op == RB_SET_UNION) {
+	if(a->hash != NULL) {
+	    while(total > (a->hash->mask + 1) / 2 && a->hash->shift > 1) {
+		rbHashGrow(a);
+	    }
+	}
+	rebuild = a->filter != NULL && a->filter->bloom->count + b->count > a->filter->capacity;
+	if(a->hash != NULL || (a->filter != NULL && !rebuild)) {
+	    for(node = b->min; node != NULL; node = rbNext(node)) {
+		if(a->hash != NULL && rbHashGet(a->hash, node->key) == NULL) {
+		    rbHashAdd(a->hash, node);
+		}
+		if(a->filter != NULL && !rebuild) {
+		    kfBloomAdd(a->filter->bloom, node->key);
+		}
+	    }
+	}
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.a = a->root;
+    job.b = b->root;
+    job.abh = rbBlackHeight(a->root);
+    job.bbh = rbBlackHeight(b->root);
+    job.op = op;
+
+    /* fork until there are a few tasks per thread, or until they get small: every level halves b, and a roughly so */
+    total = rbCountHint(a) + rbCountHint(b);
+    if(total >= 2 * RB_SET_GRAIN && (job.pool = rbGetThreadPool()) != NULL) {
+	while(((uint64_t)1 << job.forks) < 4 * ((uint64_t)job.pool->count + 1) && (total >> (job.forks + 1)) >= RB_SET_GRAIN) {
+	    job.forks++;
+	}
+    }
+
+    rbSetRun(&job);
+
+    if(job.pool != NULL) {
+	tpFree(job.pool);
+    }
+
+    a->root = job.result;
+    if(a->root != NULL) {
+	rbSetRed(a->root, false);
+    }
+    a->min = (a->root == NULL) ? NULL : rbEdge(a->root, RB_ASC);
+    a->max = (a->root == NULL) ? NULL : rbEdge(a->root, RB_DESC);
+
+    if(op == RB_SET_UNION) {
+	a->count += b->count - job.matches;
+	a->uncounted = a->uncounted || b->uncounted;
+    } else if(op == RB_SET_INTERSECT) {
+	a->count = job.matches;
+	a->uncounted = false;
+    } else {
+	a->count -= job.matches;
+    }
+
+    /* free the nodes left out here, on one thread: node pools are not thread safe */
+    for(root = job.discard; root != NULL; root = next) {
+
+	next = rbGetParent(root);
+	top = 0;
+	stack[top++] = root;
+
+	while(top > 0) {
+	    node = stack[--top];
+	    if(node->children[RB_RIGHT] != NULL) {
+		stack[top++] = node->children[RB_RIGHT];
+	    }
+	    if(node->children[RB_LEFT] != NULL) {
+		stack[top++] = node->children[RB_LEFT];
+	    }
+	    rbForgetNode(a, node);
+	    rbDropNode(a, node, NULL);
+	}
+
     }
 
-    if(b->children[RB_RIGHT] != NULL) {
-	b->children[RB_RIGHT]->parent = b;
+    if(rebuild) {
+	rbFilterRebuild(a);
+    } else if(op != RB_SET_UNION) {
+	rbFilterStale(a, count - a->count, a->count);
     }
 
-}
-#endif
+    rbClear(b);
 
-/* binary search tree insertion, return newly added node - or existing node if found */
-static inline RbNode* bstInsert(RbTree *tree, const uint32_t key) {
-
-    RbNode* current = tree->root;
-    RbNode* parent = NULL;
-    int dir = 0;
+    return a;
 
-    /* find the parent to attach new node, return if already exists */
-    while(current != NULL) {
+}
 
-	if(current->key == key) {
-	    return current;
-	}
+/* copy a subtree node by node, shape, colours and values included */
+static RbNode* rbCopyNodes(RbTree *to, RbTree *from, RbNode *node, RbNode *parent) {
 
-	parent = current;
-	dir = ( key > current->key );
-	current = current->children[dir];
+    RbNode *ret;
 
+    if(node == NULL) {
+	return NULL;
     }
 
-    /* create a new node, mark it red */
-    current = rbCreateNode(parent, key);
-
-    /* need to pre-allocate space */
-    if(tree->flags & RB_PREALLOC) {
-	xcalloc(current->value, 1, tree->valuesize);
+    ret = rbCreateNode(to, parent, node->key);
+    rbSetRed(ret, rbGetRed(node));
+#ifndef RBT_SET
+    if((from->flags & RB_PREALLOC) && from->valuesize > sizeof(void*)) {
+	memcpy(ret->value, node->value, from->valuesize);
+    } else {
+	ret->value = node->value;
     }
+#endif /* RBT_SET */
+#ifdef RBT_ORDSTAT
+    ret->size = node->size;
+#endif /* RBT_ORDSTAT */
 
-    current->red = true;
-    tree->count++;
-
-    /* link parent with new node */
-    if(parent != NULL) {
-	parent->children[dir] = current;
-    }
+    ret->children[RB_LEFT] = rbCopyNodes(to, from, node->children[RB_LEFT], ret);
+    ret->children[RB_RIGHT] = rbCopyNodes(to, from, node->children[RB_RIGHT], ret);
 
-    return current;
+    return ret;
 
 }
 
-/* perform a rotation of the given node in given direction */
-static inline void rbRotate(RbTree *tree, RbNode *root, const int dir) {
-
-    /* pivot node */
-    RbNode *pivot = root->children[!dir];
+/* copy of a tree with an allocator of its own, or sharing the allocator of another tree (and made alike it) */
+static RbTree* rbCopyTree(RbTree *tree, RbTree *share) {
 
-    /* swapsies */
-    root->children[!dir] = pivot->children[dir];
-    if(pivot->children[dir] != NULL) {
-	pivot->children[dir]->parent = root;
-    }
-    pivot->children[dir] = root;
-    pivot->parent = root->parent;
-    root->parent = pivot;
+    RbTree *ret;
 
-    /* link parent to pivot, or update tree root if pivot is the new root */
-    if(pivot->parent == NULL) {
-	tree->root = pivot;
+    if(share != NULL) {
+	ret = rbCreateAlike(share);
     } else {
-	int pdir = (pivot->parent->children[RB_RIGHT] == root);
-	pivot->parent->children[pdir] = pivot;
+	ret = rbCreateExt(tree->flags, tree->valuesize, tree->freeCallback);
+	if(tree->cache != NULL) {
+	    rbCacheEnable(ret, (uint32_t)1 << (32 - tree->cache->shift));
+	}
     }
 
+    ret->root = rbCopyNodes(ret, tree, tree->root, NULL);
+    ret->count = rbCount(tree);
+    ret->min = (ret->root == NULL) ? NULL : rbEdge(ret->root, RB_ASC);
+    ret->max = (ret->root == NULL) ? NULL : rbEdge(ret->root, RB_DESC);
+    rbIndexFrom(ret, ret->min, ret->count);
+
+    return ret;
+
 }
 
-/* callback freeing a node */
-static RbNode* rbFreeCallback(RbTree *tree, RbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber) {
+/* run a set operation on copies of two trees, which are left untouched */
+static RbTree* rbSetOperationCopy(RbTree *a, RbTree *b, const int op) {
 
-    if(node == tree->root) {
-	tree->root = NULL;
-    }
+    RbTree *ret, *tmp;
 
-    if(tree->freeCallback != NULL) {
-	tree->freeCallback(node->value);
+    /* values are copied as they are, so nobody may own them */
+    if((a->flags & RB_INTRUSIVE) || a->flags != b->flags || a->valuesize != b->valuesize
+		|| a->freeCallback != NULL || b->freeCallback != NULL) {
+	return NULL;
     }
 
-    if(tree->flags & RB_PREALLOC) {
-	free(node->value);
+    /* the result must not share a's pool: a would lose its O(1) rbEmpty() for as long as the result lives */
+    ret = rbCopyTree(a, NULL);
+    tmp = rbCopyTree(b, ret);
+
+    rbSetOperation(ret, tmp, op);
+    rbFree(tmp);
+
+    if(a->filter != NULL) {
+	rbFilterEnable(ret, a->filter->bitsperkey);
     }
 
-    free(node);
+    return ret;
 
-    return NULL;
 }
 
-/* callback used for tree verification */
-static RbNode* rbVerifyCallback(RbTree *tree, RbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber) {
+/* union in place */
+RbTree* rbUnion(RbTree *a, RbTree *b) {
 
-    RbVerifyState *state = user;
+    return rbSetOperation(a, b, RB_SET_UNION);
 
-    if(node != NULL) {
+}
 
-	if(height > state->maxheight) {
-	    state->maxheight = height;
-	}
+/* intersection in place */
+RbTree* rbIntersect(RbTree *a, RbTree *b) {
 
-	/* check black height of node with zero or one child */
-	if(node->children[RB_LEFT] == NULL || node->children[RB_RIGHT] == NULL) {
+    return rbSetOperation(a, b, RB_SET_INTERSECT);
 
-	    if(state->maxbh == 0) {
-		state->maxbh = bh;
-	    }
+}
 
-	    /* if we see any changes in black height, tree is invalid */
-	    if(bh != state->maxbh) {
-		state->valid = false;
-		if(state->chatty) {
-		    fprintf(stderr, "Black height violation: key %d black height %d != previous black height seen %d\n", node->key, bh, state->maxbh);
-		}
-		if(state->stop) {
-		    *cont = false;
-		    return node;
-		}
-		state->maxbh = bh;
-	    }
+/* difference in place */
+RbTree* rbDifference(RbTree *a, RbTree *b) {
 
-	}
+    return rbSetOperation(a, b, RB_SET_DIFFERENCE);
 
-	if(node->red && rbRed(node->parent)) {
-	    state->valid = false;
-	    if(state->chatty) {
-		fprintf(stderr, "Red-red violation: key %d red -> parent key %d red\n", node->key, node->parent->key);
-	    }
-	    if(state->stop) {
-		    *cont = false;
-	    }
-	}
+}
 
-    }
+/* union into a new tree */
+RbTree* rbUnionCopy(RbTree *a, RbTree *b) {
 
-    return node;
+    return rbSetOperationCopy(a, b, RB_SET_UNION);
 
 }
 
-/* create a red-black tree */
-RbTree* rbCreate() {
+/* intersection into a new tree */
+RbTree* rbIntersectCopy(RbTree *a, RbTree *b) {
 
-    RbTree *ret;
+    return rbSetOperationCopy(a, b, RB_SET_INTERSECT);
 
-    xcalloc(ret, 1, sizeof(RbTree));
+}
 
-    return ret;
+/* difference into a new tree */
+RbTree* rbDifferenceCopy(RbTree *a, RbTree *b) {
 
-}
+    return rbSetOperationCopy(a, b, RB_SET_DIFFERENCE);
 
-/* create a red-black tree that will pre-allocate values of given size on insertion */
-RbTree* rbCreatePrealloc(const size_t valuesize, void (*freeCallback) (void *value)) {
+}
 
-    RbTree *ret = rbCreate();
+/* size the set operation thread pool: the current one stops once set operations still using it are done */
+void rbSetThreads(const unsigned int threads) {
 
-    if(ret != NULL) {
-	ret->freeCallback = freeCallback;
-	ret->valuesize = valuesize;
-	ret->flags |= RB_PREALLOC;
-    }
+    pthread_mutex_lock(&rbThreadLock);
+    tpFree(rbThreadPool);
+    rbThreadPool = NULL;
+    rbThreads = threads;
+    pthread_mutex_unlock(&rbThreadLock);
 
-    return ret;
 }
 
-/* binary search tree search (in a red-black tree) */
-RbNode* rbSearch(RbNode *root, const uint32_t key) {
+/* LSD radix sort of a copy of the batch, 8 bits per pass, duplicates dropped: returns the sorted buffer, *n = key count */
+static uint32_t* rbSortBatch(const uint32_t *keys, const uint32_t count, uint32_t *buf, uint32_t *tmp, uint32_t *n) {
 
-    RbNode *current = root;
+    uint32_t offsets[256];
+    uint32_t shift, i, j;
 
-    while(current != NULL) {
+    memcpy(buf, keys, (size_t)count * sizeof(uint32_t));
 
-	if(current->key == key) {
-	    return current;
+    for(shift = 0; shift < 32; shift += 8) {
+
+	uint32_t *swap;
+	uint32_t sum = 0;
+
+	memset(offsets, 0, sizeof(offsets));
+	for(i = 0; i < count; i++) {
+	    offsets[(buf[i] >> shift) & 0xff]++;
 	}
 
-	current = current->children[key > current->key];
+	/* all keys agree on this byte, the order stays as it is */
+	if(offsets[(buf[0] >> shift) & 0xff] == count) {
+	    continue;
+	}
 
-    }
+	for(i = 0; i < 256; i++) {
+	    const uint32_t c = offsets[i];
+	    offsets[i] = sum;
+	    sum += c;
+	}
 
-    return NULL;
-}
+	for(i = 0; i < count; i++) {
+	    tmp[offsets[(buf[i] >> shift) & 0xff]++] = buf[i];
+	}
 
-/* insert a key into the tree, return the newly inserted node, or existing node if key exists */
-RbNode* rbInsert(RbTree *tree, const uint32_t key) {
+	swap = buf;
+	buf = tmp;
+	tmp = swap;
 
-    /* the new node is coloured red only on creation - if exists, no change of colour, so no violations */
-    RbNode *ret = bstInsert(tree, key);
-    RbNode *current = ret;
+    }
 
-    /* empty tree, new root */
-    if(tree->root == NULL) {
-	tree->root = ret;
-	tree->root->red = false;
-	return ret;
+    for(i = 1, j = 1; i < count; i++) {
+	if(buf[i] != buf[j - 1]) {
+	    buf[j++] = buf[i];
+	}
     }
 
-    /* travel upwards and correct red->red violations */
-    while(rbRed(current) && rbRed(current->parent)) {
+    *n = j;
+    return buf;
 
-	RbNode *parent = current->parent;
-	RbNode *grandparent = parent->parent;
+}
 
-	/* parent's direction */
-	int dir = rbDir(parent);
-	int otherdir = !dir;
+/* insert sorted, distinct keys by merging them with the tree's nodes and relinking everything into a balanced tree */
+static uint32_t rbMergeInsert(RbTree *tree, const uint32_t *keys, const uint32_t n) {
 
-	/* knowing the parent's direction, uncle is the other guy */
-	RbNode *uncle = grandparent->children[otherdir];
+    RbBuildState state;
+    RbNode **links, **fresh;
+    RbNode *node = tree->min;
+    uint32_t total = 0, added = 0, i = 0;
+    bool rebuild;
 
-	/* red uncle: recolour, move up */
-	if(rbRed(uncle)) {
-	    grandparent->red = true;
-	    parent->red = false;
-	    uncle->red = false;
-	    current = grandparent;
-	/* black uncle - rotate and recolour */
+    xmalloc(links, ((size_t)rbCount(tree) + n) * sizeof(RbNode*));
+    xmalloc(fresh, (size_t)n * sizeof(RbNode*));
+
+    /* the old links are only walked here, before anything is relinked */
+    while(node != NULL || i < n) {
+	if(i < n && (node == NULL || keys[i] < node->key)) {
+	    links[total++] = fresh[added++] = rbCreateNode(tree, NULL, keys[i++]);
 	} else {
-	    /* current is in the opposite direction to parent - there will be two rotations */
-	    if(current == parent->children[otherdir]) {
-		    rbRotate(tree, parent, dir);
-		    current = parent;
-		    parent = current->parent;
+	    if(i < n && keys[i] == node->key) {
+		i++;
 	    }
+	    links[total++] = node;
+	    node = rbNext(node);
+	}
+    }
 
-	    /* rotate */
-	    rbRotate(tree, grandparent, otherdir);
+    state.links = links;
+    rbBuildTree(tree, &state, total);
 
-	    /* recolour, move up */
-	    parent->red = false;
-	    grandparent->red = true;
-	    current = parent;
+    /*
+     * the new nodes are all linked by now, so a filter rebuild would take them all in: rebuild once if they do not fit,
+     * rather than add them and have it fill up halfway (same for the hash index, grown to size first)
+     */
+    rebuild = tree->filter != NULL && tree->filter->bloom->count + added > tree->filter->capacity;
 
+    if(tree->hash != NULL) {
+	while(tree->count > (tree->hash->mask + 1) / 2 && tree->hash->shift > 1) {
+	    rbHashGrow(tree);
 	}
-
     }
 
-    tree->root->red = false;
-
-    /* return new node */
-    return ret;
+    for(i = 0; i < added; i++) {
+	if(tree->hash != NULL) {
+	    rbHashAdd(tree->hash, fresh[i]);
+	}
+	if(tree->filter != NULL && !rebuild) {
+	    kfBloomAdd(tree->filter->bloom, fresh[i]->key);
+	}
+    }
 
-}
+    if(rebuild) {
+	rbFilterRebuild(tree);
+    }
 
-/* binary search tree deletion with red-black tree fixup combined */
-void rbDeleteNode(RbTree *tree, RbNode *node) {
+    free(links);
+    free(fresh);
 
-    /* unbalanced parent, happy children, yay! */
-    RbNode *ubparent = NULL;
-    int dir = 0;
+    return added;
 
-    if(node != NULL) {
+}
 
-	/* if the node to be deleted is has two children, we find the successor and work with it, since this is the node to delete */
-	if(node->children[RB_LEFT] != NULL && node->children[RB_RIGHT] != NULL) {
+/* delete sorted, distinct keys by relinking the remaining nodes into a balanced tree */
+static uint32_t rbMergeDelete(RbTree *tree, const uint32_t *keys, const uint32_t n) {
 
-	    /* right first */
-	    RbNode *successor = node->children[RB_RIGHT];
-	    while(successor->children[RB_LEFT] != NULL) {
-		/* then left all the way */
-		successor = successor->children[RB_LEFT];
-	    }
+    RbBuildState state;
+    RbNode **links;
+    RbNode *node = tree->min;
+    const uint32_t count = rbCount(tree);
+    uint32_t kept = 0, removed = count, i = 0, j;
 
-	    /* copy the successor's data into old node, preserve colour */
-	    node->key = successor->key;
-	    node->value = successor->value;
+    /* nodes to keep fill the array from the front, nodes to delete from the back */
+    xmalloc(links, ((count > 0) ? count : 1) * sizeof(RbNode*));
 
-	    /* need to delete this guy now */
-	    node = successor;
-	
+    while(node != NULL) {
+	while(i < n && keys[i] < node->key) {
+	    i++;
 	}
-	
-	/* at this point the node we are working with can ony have one child or zero children */
-
-	/* if node has one child, this leads us to it. if it has none, it will point to NULL */
-	RbNode *promoted = node->children[node->children[RB_LEFT] == NULL];
-
-	/* fix parent link - or root link */
-	if(node->parent == NULL) {
-	    tree->root = promoted;
+	if(i < n && keys[i] == node->key) {
+	    links[--removed] = node;
+	    i++;
 	} else {
-	    dir = rbDir(node);
-	    node->parent->children[dir] = promoted;
+	    links[kept++] = node;
 	}
+	node = rbNext(node);
+    }
 
-	/* fix promoted node's parent link */
-	if(promoted != NULL) {
-	    promoted->parent = node->parent;
-	}
-	
-	/* if node and node's child differ in colour, promoted node needs to be black to keep the black height, and we are done */
-	if(node->red != rbRed(promoted)) {
-	    if(!node->red) {
-		promoted->red = false;
-	    }
-	    tree->count--;
-	    free(node);
-	    return;
+    state.links = links;
+    rbBuildTree(tree, &state, kept);
+
+    for(j = removed; j < count; j++) {
+	node = links[j];
+	rbForgetNode(tree, node);
+	if(tree->flags & RB_INTRUSIVE) {
+	    node->children[0] = node->children[1] = NULL;
+	    rbInitParent(node, NULL, false);
 	} else {
-	    /* our disturbed node is removed, and instead of "double black" or other such nonsense, we track its parent and direction towards it */
-	    ubparent = node->parent;
-	    tree->count--;
-	    free(node);
-	    if(ubparent != NULL) {
-		ubparent->children[dir] = NULL;
-	    }
+	    rbDestroyNode(tree, node);
 	}
+    }
 
-	/* keep going as long as we have some rebalancing to do */
-	while(ubparent != NULL ) {
+    rbFilterStale(tree, count - kept, tree->count);
 
-	    int otherdir = !dir;
-	    RbNode *ubsibling = ubparent->children[otherdir];
+    free(links);
 
-	    /* case 1: parent black, sibling red... the tree was balanced before, so if sibling red, parent must be black, recolour and continue */
-	    if(rbRed(ubsibling)) {
+    return count - kept;
 
-		rbRotate(tree, ubparent, dir);
-		ubparent->red = true;
-		ubsibling->red = false;
+}
 
-	    /* case 2: sibling black (because not red, above), has red child on opposite side to unbalanced node: rotate, recolour, done */
-	    } else if(rbRed(ubsibling->children[otherdir])) {
+/* insert a batch of keys */
+uint32_t rbInsertBatch(RbTree *tree, const uint32_t *keys, const uint32_t count) {
 
-		ubsibling->children[otherdir]->red = false;
-		ubsibling->red = ubparent->red;
-		ubparent->red = false;
-		rbRotate(tree, ubparent, dir);
-		return;
+    uint32_t *buf, *tmp, *sorted;
+    uint32_t n, i, ret = 0;
 
-	    /* case 3: sibling black, has red child on same side as deleted node: recolour, rotate and we turn into case 1 */
-	    } else if(rbRed(ubsibling->children[dir])) {
+    if((tree->flags & RB_INTRUSIVE) || count == 0) {
+	return 0;
+    }
 
-		ubsibling->children[dir]->red = false;
-		ubsibling->red = true;
-		rbRotate(tree, ubsibling, otherdir);
+    xmalloc(buf, (size_t)count * sizeof(uint32_t));
+    xmalloc(tmp, (size_t)count * sizeof(uint32_t));
+    sorted = rbSortBatch(keys, count, buf, tmp, &n);
 
-	    /* case 4: red parent: recolour, done */
-	    } else if(ubparent->red) {
+    if((uint64_t)n * RB_BATCH_REBUILD >= rbCountHint(tree)) {
+	ret = rbMergeInsert(tree, sorted, n);
+    } else {
+	RbNode *finger = NULL;
+	for(i = 0; i < n; i++) {
+	    const uint32_t before = tree->count;
+	    finger = rbInsertFixup(tree, bstInsert(tree, (finger == NULL) ? tree->root : rbClimb(finger, sorted[i]), sorted[i], NULL));
+	    ret += tree->count - before;
+	}
+    }
 
-		ubparent->red = false;
-		ubsibling->red = true;
-		return;
+    free(buf);
+    free(tmp);
 
-	    /* case 5: parent and sibling black - mark sibling red and rebalance from parent */
-	    } else {
+    return ret;
 
-		ubsibling->red = true;
-		if(ubparent->parent != NULL) {
-		    /* no need to do this every time */
-		    dir = rbDir(ubparent);
-		}
-		ubparent = ubparent->parent;
+}
 
-	    }
-	
-	}
+/* delete a batch of keys */
+uint32_t rbDeleteBatch(RbTree *tree, const uint32_t *keys, const uint32_t count) {
+
+    uint32_t *buf, *tmp, *sorted;
+    uint32_t n, i, ret = 0;
 
+    if(count == 0 || tree->root == NULL) {
+	return 0;
     }
 
-}
+    xmalloc(buf, (size_t)count * sizeof(uint32_t));
+    xmalloc(tmp, (size_t)count * sizeof(uint32_t));
+    sorted = rbSortBatch(keys, count, buf, tmp, &n);
 
-/* delete the node with the given key from red-black tree */
-void rbDeleteKey(RbTree *tree, const uint32_t key) {
+    if((uint64_t)n * RB_BATCH_REBUILD >= rbCountHint(tree)) {
+	ret = rbMergeDelete(tree, sorted, n);
+    } else {
+	/* the deleted node's successor survives the deletion (nodes are relinked, not copied), so it is the next finger */
+	RbNode *finger = NULL;
+	for(i = 0; i < n; i++) {
+	    RbNode *node = rbSearchFrom(tree, finger, sorted[i]);
+	    if(node != NULL) {
+		finger = rbNext(node);
+		rbDeleteNode(tree, node);
+		ret++;
+	    }
+	}
+    }
+
+    free(buf);
+    free(tmp);
 
-    rbDeleteNode(tree, rbSearch(tree->root, key));
+    return ret;
 
 }
 
@@ -494,7 +2918,7 @@ void rbInOrderTrack(RbTree *tree, RbCallback callback, void *user, const int dir
 
 		/* maintain running height and black height */
 		height++;
-		bh += !current->red;
+		bh += !rbGetRed(current);
 		if( lastdir == otherdir ) {
 		    height++;
 		}
@@ -511,9 +2935,9 @@ void rbInOrderTrack(RbTree *tree, RbCallback callback, void *user, const int dir
 		    /* bounceback */
 		    height--;
 		} else {
-		    for(tmp = last; tmp != NULL && tmp != current; tmp = tmp->parent) {
+		    for(tmp = last; tmp != NULL && tmp != current; tmp = rbGetParent(tmp)) {
 			height--;
-			bh -= !tmp->red;
+			bh -= !rbGetRed(tmp);
 		    }
 		}
 		lastdir = otherdir;
@@ -716,7 +3140,7 @@ uint32_t rbInOrderRangeTrack(RbTree *tree, RbCallback callback, void *user, cons
 
 	int tmpdir = (startrange > current->key);
 
-	bh += !current->red;
+	bh += !rbGetRed(current);
 	height++;
 	last = current;
 
@@ -746,7 +3170,7 @@ uint32_t rbInOrderRangeTrack(RbTree *tree, RbCallback callback, void *user, cons
 
 		/* maintain running height and black height */
 		height++;
-		bh += !current->red;
+		bh += !rbGetRed(current);
 		if( lastdir == otherdir ) {
 		    height++;
 		}
@@ -763,9 +3187,9 @@ uint32_t rbInOrderRangeTrack(RbTree *tree, RbCallback callback, void *user, cons
 		    /* bounceback */
 		    height--;
 		} else {
-		    for(tmp = last; tmp != NULL && tmp != current; tmp = tmp->parent) {
+		    for(tmp = last; tmp != NULL && tmp != current; tmp = rbGetParent(tmp)) {
 			height--;
-			bh -= !tmp->red;
+			bh -= !rbGetRed(tmp);
 		    }
 		}
 		lastdir = otherdir;
@@ -816,7 +3240,7 @@ void rbBreadthFirstTrack(RbTree *tree, RbCallback callback, void *user, const in
 
     /* find black height to get a good approximation of queue size needed */
     while(walker != NULL) {
-	bh += !walker->red;
+	bh += !rbGetRed(walker);
 	walker = walker->children[RB_LEFT];
     }
 
@@ -832,13 +3256,13 @@ void rbBreadthFirstTrack(RbTree *tree, RbCallback callback, void *user, const in
 
 	    if((tmp.node = current.node->children[dir]) != NULL) {
 		tmp.height = current.height + 1;
-		tmp.bh = current.bh + !tmp.node->red;
+		tmp.bh = current.bh + !rbGetRed(tmp.node);
 		dfqPush(queue, &tmp);
 	    }
 
 	    if((tmp.node = current.node->children[otherdir]) != NULL) {
 		tmp.height = current.height + 1;
-		tmp.bh = current.bh + !tmp.node->red;
+		tmp.bh = current.bh + !rbGetRed(tmp.node);
 		dfqPush(queue, &tmp);
 	    }
 
@@ -864,7 +3288,7 @@ void rbBreadthFirst(RbTree *tree, RbCallback callback, void *user, const int dir
 
     /* find black height to get a good approximation of queue size needed */
     while(current != NULL) {
-	bh += !current->red;
+	bh += !rbGetRed(current);
 	current = current->children[RB_LEFT];
     }
 
@@ -902,7 +3326,7 @@ RbNode* rbDumpCallback(RbTree *tree, RbNode *node, void *user, const int bh, con
 
     printf("key %d, %s, height %d, black height %d, parent %d%s%s\n",
 		    (node==NULL)? 0:node->key,(node == NULL) ? "x " : rbCname(node), height, bh,
-		    (node->parent == NULL) ? 0 : node->parent->key,
+		    (rbGetParent(node) == NULL) ? 0 : rbGetParent(node)->key,
 		    (node->children[RB_LEFT] == NULL && node->children[RB_RIGHT] == NULL) ? ", no children" : "",
 		    (node == tree->root) ? ", is root" : ""
     );
@@ -940,10 +3364,17 @@ bool rbVerify(RbTree *tree, bool chatty, bool stop) {
 
     rbInOrderTrack(tree, rbVerifyCallback, &state, RB_ASC);
 
+    if(tree->min != rbEdge(tree->root, RB_LEFT) || tree->max != rbEdge(tree->root, RB_RIGHT)) {
+	state.valid = false;
+	if(chatty) {
+	    fprintf(stderr, "Lowest / highest node pointer violation\n");
+	}
+    }
+
     if(chatty) {
 
 	if(state.valid) {
-	    fprintf(stderr, "Valid red-black tree, node count %d, max height %d, black height %d\n", tree->count, state.maxheight, state.maxbh);
+	    fprintf(stderr, "Valid red-black tree, node count %d, max height %d, black height %d\n", rbCount(tree), state.maxheight, state.maxbh);
 	} else {
 	    fprintf(stderr, "Invalid red-black tree.\n");
 	}
@@ -958,7 +3389,18 @@ bool rbVerify(RbTree *tree, bool chatty, bool stop) {
 void rbFree(RbTree *tree) {
 
     if(tree != NULL) {
-	rbInOrder(tree, rbFreeCallback, NULL, RB_ASC);
+
+	rbEmpty(tree);
+	rbCacheDisable(tree);
+	rbFilterDisable(tree);
+	rbHashFree(tree->hash);
+
+	if(tree->flags & RB_POOL_TLS) {
+	    rbTlsRefs--;
+	} else if(tree->pool != NULL) {
+	    mpFree(tree->pool);
+	}
+
 	free(tree);
     }
 
@@ -968,7 +3410,22 @@ void rbFree(RbTree *tree) {
 void rbEmpty(RbTree *tree) {
 
     if(tree != NULL) {
-	rbInOrder(tree, rbFreeCallback, NULL, RB_ASC);
+
+	/* intrusive tree nodes belong to the caller, we just let go of them */
+	if(tree->flags & RB_INTRUSIVE) {
+	    ;
+	/* a private pool (not shared since a split) takes all nodes and values with it, we only visit nodes for the free callback */
+	} else if(tree->pool != NULL && !(tree->flags & RB_POOL_TLS) && tree->pool->users == 1) {
+	    if(tree->freeCallback != NULL) {
+		rbInOrder(tree, rbFreeValueCallback, NULL, RB_ASC);
+	    }
+	    mpReset(tree->pool);
+	} else {
+	    rbInOrder(tree, rbFreeCallback, NULL, RB_ASC);
+	}
+
+	rbClear(tree);
+
     }
 
 }
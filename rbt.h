@@ -38,8 +38,12 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 
+#include "mp.h"
+#include "kf.h"
+
 /* constants */
 
 /* silent / chatty tree verification */
@@ -63,31 +67,161 @@
 #define RB_EXCL 1 /* exclude limit */
 #define RB_INF  2 /* no limit */
 
+/* tallest possible tree: 2 * log2(n + 1) for n < 2^32 nodes */
+#define RB_MAX_HEIGHT 64
+
+/* number of descents rbSearchBatch() keeps in flight */
+#define RB_BATCH_SLOTS 16
+
+/* batch updates: a batch of at least 1 / RB_BATCH_REBUILD of the tree size is merged into a rebuilt tree */
+#define RB_BATCH_REBUILD 4
+
+/* range deletion: ranges of fewer keys are deleted key by key, which beats splitting the tree */
+#define RB_RANGE_SPLIT 8
+
+/* parallel set operations: parts of fewer keys than this (estimated) are not handed to another thread */
+#define RB_SET_GRAIN 16384
+
+/* hash index: initial slot count, the table doubles when more than half full (and never shrinks) */
+#define RB_HASH_MIN 64
+
+/* negative lookup filter: default bits per key, the smallest number of keys it is sized for, and of deleted keys it is rebuilt for */
+#define RB_FILTER_BITS 10
+#define RB_FILTER_MIN 256
+#define RB_FILTER_MIN_STALE 64
+
 /* tree flags */
 #define RB_PREALLOC (1 << 0) /* preallocate value for each node */
+#define RB_POOL     (1 << 1) /* allocate nodes from a per-tree slab pool */
+#define RB_POOL_TLS (1 << 2) /* allocate nodes from a pool shared by all RB_POOL_TLS trees in the calling thread */
+#define RB_ARENA    (1 << 3) /* allocate nodes (and preallocated values with them) from a per-tree pool, empty the tree in one go */
+#define RB_INTRUSIVE (1 << 4) /* nodes are embedded in caller's records and owned by the caller, the tree never allocates or frees */
+#define RB_HASH     (1 << 5) /* keep a key -> node hash index alongside the tree, for O(1) rbLookup() */
 
 typedef struct RbNode RbNode;
 
-/* the tree node */
+/*
+ * the tree node. Build-time layout options:
+ * RBT_COMPACT: node colour is kept in the lowest bit of the parent pointer (nodes are at least pointer-aligned). On
+ *              64-bit platforms the colour byte only fills padding, so this shrinks the node with RBT_ORDSTAT alone
+ * RBT_SET:     key-only set, no value pointer - a node is 32 bytes instead of 40 on 64-bit platforms
+ * RBT_ORDSTAT: order statistics, nodes keep their subtree size for rank / select / range count queries: 48 bytes,
+ *              40 with RBT_COMPACT or RBT_SET, 32 with both
+ */
 struct RbNode {
     /* indexed children, makes life so much easier */
     RbNode* children[2];
+#ifdef RBT_COMPACT
+    uintptr_t parentcol;
+#else
     RbNode* parent;
+#endif /* RBT_COMPACT */
+#ifndef RBT_SET
     void* value;
+#endif /* RBT_SET */
     uint32_t key;
+#ifdef RBT_ORDSTAT
+    uint32_t size; /* number of nodes in the subtree rooted here, use rbSize() */
+#endif /* RBT_ORDSTAT */
+#ifndef RBT_COMPACT
     /* could be something bigger with bit flags. To investigate: child and parent colour flags as well as our own */
     bool red;
+#endif /* RBT_COMPACT */
 };
 
+/* node parent and colour accessors - use these, not the fields */
+#ifdef RBT_COMPACT
+#define rbGetParent(node)		((RbNode*)((node)->parentcol & ~(uintptr_t)1))
+#define rbGetRed(node)			((bool)((node)->parentcol & 1))
+#define rbSetParent(node, p)		((node)->parentcol = (uintptr_t)(p) | ((node)->parentcol & 1))
+#define rbSetRed(node, r)		((node)->parentcol = ((node)->parentcol & ~(uintptr_t)1) | (uintptr_t)((r) != 0))
+#define rbInitParent(node, p, r)	((node)->parentcol = (uintptr_t)(p) | (uintptr_t)((r) != 0))
+#else
+#define rbGetParent(node)		((node)->parent)
+#define rbGetRed(node)			((node)->red)
+#define rbSetParent(node, p)		((node)->parent = (p))
+#define rbSetRed(node, r)		((node)->red = (r))
+#define rbInitParent(node, p, r)	((node)->parent = (p), (node)->red = (r))
+#endif /* RBT_COMPACT */
+
+#ifdef RBT_ORDSTAT
+/* subtree size, 0 for NULL */
+#define rbSize(node)			(((node) == NULL) ? 0 : (node)->size)
+#endif /* RBT_ORDSTAT */
+
+/* direct-mapped hot key cache: key -> node, consulted by rbLookup() */
+typedef struct {
+    RbNode **slots;
+    uint32_t shift; /* 32 - log2(slot count), for multiplicative hashing */
+    uint64_t hits;
+    uint64_t misses;
+} RbCache;
+
+/* hash index slot, empty if node is NULL. The key is kept here so that a probe does not touch the node */
+typedef struct {
+    RbNode *node;
+    uint32_t key;
+} RbHashSlot;
+
+/* hash index of a RB_HASH tree: open addressing, linear probing, backward shift deletion */
+typedef struct {
+    RbHashSlot *slots;
+    uint32_t mask; /* slot count - 1 */
+    uint32_t shift; /* 32 - log2(slot count), for multiplicative hashing */
+} RbHash;
+
+/*
+ * negative lookup filter: a blocked Bloom filter of the tree's keys, consulted by rbLookup(). Deleted keys stay in the
+ * filter until it is rebuilt - once they outnumber half the live keys (and RB_FILTER_MIN_STALE), or when insertions
+ * outgrow its capacity
+ */
+typedef struct {
+    KfBloom *bloom;
+    uint32_t bitsperkey;
+    uint32_t capacity; /* keys the filter is sized for, rebuilt for twice the key count when exceeded */
+    uint32_t stale; /* deleted keys still in the filter */
+    uint64_t rebuilds;
+    uint64_t negatives; /* lookups answered by the filter alone */
+    uint64_t falsepositives; /* lookups let through by the filter that missed in the tree */
+} RbFilter;
+
+/* negative lookup filter statistics, see rbFilterStats() */
+typedef struct {
+    size_t bytes; /* memory taken by the filter bits */
+    double bitsperkey; /* per live key */
+    double fpr; /* expected false positive rate, including stale keys */
+    double measuredfpr; /* false positives (deleted keys still in the filter included) / lookups of absent keys */
+    uint64_t negatives;
+    uint64_t falsepositives;
+    uint64_t rebuilds;
+} RbFilterStats;
+
 /* tree container; node count is maintained at minimal cost */
 typedef struct {
     RbNode *root;
+    RbNode *min; /* node with the lowest key, NULL if empty */
+    RbNode *max; /* node with the highest key, NULL if empty */
+    RbCache *cache; /* hot key cache, NULL if not enabled */
+    RbFilter *filter; /* negative lookup filter, NULL if not enabled */
+    RbHash *hash; /* key -> node hash index, RB_HASH trees only */
+    MPool *pool; /* node pool, NULL if nodes are malloc'd */
     void (*freeCallback) (void *value); /* callback to be called to free preallocated values */
     size_t valuesize;
-    uint32_t count;
+    size_t nodesize; /* node allocation size, including any inline value */
+    uint32_t count; /* node count - but see rbCount() */
+    bool uncounted; /* count unknown since a split without RBT_ORDSTAT, until rbCount() */
     unsigned int flags;
 } RbTree;
 
+/*
+ * pointer to a node's preallocated value in a RB_PREALLOC tree: values larger than a pointer live in the same
+ * allocation right behind the node (and node->value points there), smaller ones are stored in the value slot itself
+ */
+#define rbValue(tree, node) (((tree)->valuesize > sizeof(void*)) ? (node)->value : (void*)&(node)->value)
+
+/* get the record containing an embedded node (or any other member) in an intrusive tree */
+#define rbContainerOf(ptr, type, member) ((type*)((char*)(ptr) - offsetof(type, member)))
+
 /*
  * callback typedef. Callback must return the node it was passed (in case it frees it and returns NULL), and takes arguments:
  * tree, node, user data pointer, black height of node, height (path length) of node,
@@ -99,21 +233,192 @@ typedef RbNode* (*RbCallback) (RbTree*, RbNode*, void*, const int, const int, bo
 
 /* create an empty red-black tree */
 RbTree*		rbCreate();
-/* create an empty red-black tree, but preallocate values */
+/* create an empty red-black tree, but preallocate values, accessed with rbValue() (returns NULL in a RBT_SET build) */
 RbTree*		rbCreatePrealloc(const size_t valuesize, void (*freeCallback) (void *value));
+/* create an empty red-black tree allocating nodes from a pool, flags: RB_POOL_TLS to use the thread's shared pool */
+RbTree*		rbCreatePool(const unsigned int flags);
+/* create an empty arena-backed red-black tree, preallocating values if valuesize > 0; rbEmpty() / rbFree() drop the arena in one go */
+RbTree*		rbCreateArena(const size_t valuesize, void (*freeCallback) (void *value));
+/* create an empty red-black tree with any combination of tree flags; valuesize and freeCallback are used with RB_PREALLOC */
+RbTree*		rbCreateExt(const unsigned int flags, const size_t valuesize, void (*freeCallback) (void *value));
+/* create an empty intrusive tree: nodes are embedded in caller's records, linked with rbInsertNode(), unlinked with rbRemoveNode() */
+RbTree*		rbCreateIntrusive();
+
+/*
+ * build a pooled tree from n keys in strictly ascending order, with their values (NULL for none, ignored in a RBT_SET
+ * build), in O(n): a perfectly balanced tree, black except for the deepest level if that is incomplete. Nodes are taken
+ * from one contiguous block, in key order. Returns NULL if the keys are not strictly ascending
+ */
+RbTree*		rbBuildSorted(const uint32_t *keys, void **values, const uint32_t n);
+
+/*
+ * number of keys, same as tree->count - except after rbSplit() in a build without RBT_ORDSTAT, which leaves the counts
+ * of both parts unknown rather than walking one, so that the first rbCount() on a part counts it in O(n)
+ */
+uint32_t	rbCount(RbTree *tree);
+
+/* free the calling thread's shared node pool, returns false if any RB_POOL_TLS trees still use it */
+bool		rbPoolThreadFree();
 
 /* search for key, return node */
 RbNode*		rbSearch(RbNode *root, const uint32_t key);
 
-/* insert key into tree */
+/* ordered queries, O(log n) and allocation-free, NULL if there is no such node */
+/* first node with key >= key */
+RbNode*		rbLowerBound(RbTree *tree, const uint32_t key);
+/* first node with key > key */
+RbNode*		rbUpperBound(RbTree *tree, const uint32_t key);
+/* last node with key <= key */
+RbNode*		rbFloor(RbTree *tree, const uint32_t key);
+/* first node with key >= key, same as rbLowerBound() */
+RbNode*		rbCeiling(RbTree *tree, const uint32_t key);
+/* node with the key closest to key, the lower one on a tie */
+RbNode*		rbNearest(RbTree *tree, const uint32_t key);
+
+#ifdef RBT_ORDSTAT
+/* order statistics, O(log n), RBT_ORDSTAT builds only */
+/* number of keys lower than key - the 0-based position key has or would have */
+uint32_t	rbRank(RbTree *tree, const uint32_t key);
+/* node with the index-th lowest key, 0-based, NULL if index >= count */
+RbNode*		rbSelect(RbTree *tree, const uint32_t index);
+/* number of keys in range, same range qualifiers as rbInOrderRange() */
+uint32_t	rbCountRange(RbTree *tree, const uint32_t low, const int lowqual, const uint32_t high, const int highqual);
+#endif /* RBT_ORDSTAT */
+
+/*
+ * search for key: one or two probes of the hash index in a RB_HASH tree, otherwise through the hot key cache and the
+ * negative lookup filter if enabled. Same result as rbSearch()
+ */
+RbNode*		rbLookup(RbTree *tree, const uint32_t key);
+
+/*
+ * enable the hot key cache with at least given number of slots (rounded up to a power of 2), or resize it and reset its
+ * statistics; the cache is kept coherent by deletion and rbEmpty(). Hit and miss counts are in tree->cache
+ */
+void		rbCacheEnable(RbTree *tree, const uint32_t slots);
+/* drop the hot key cache */
+void		rbCacheDisable(RbTree *tree);
+
+/*
+ * enable the negative lookup filter with given bits per key (0 = RB_FILTER_BITS), or rebuild it, so that rbLookup()
+ * settles most misses after reading one cache line. Kept up to date by insertion, deletion and rbEmpty()
+ */
+void		rbFilterEnable(RbTree *tree, const uint32_t bitsperkey);
+/* drop the negative lookup filter */
+void		rbFilterDisable(RbTree *tree);
+/* fill in negative lookup filter statistics, returns false if the filter is not enabled */
+bool		rbFilterStats(RbTree *tree, RbFilterStats *stats);
+
+/*
+ * finger search: search for key starting from a node in the tree (the finger, usually the last node found), climbing
+ * only as far as needed. O(log d) for keys d positions apart, so runs of nearby keys are cheap. NULL finger = rbSearch()
+ */
+RbNode*		rbSearchFrom(RbTree *tree, RbNode *finger, const uint32_t key);
+
+/*
+ * search for count keys at once with their descents interleaved, so that cache misses overlap: out[i] is set to the node
+ * holding keys[i], or NULL. Returns the number of keys found. Pays off for batches of 16 keys and up on trees out of cache
+ */
+uint32_t	rbSearchBatch(RbTree *tree, const uint32_t *keys, const uint32_t count, RbNode **out);
+
+/* insert key into tree (returns NULL for intrusive trees) */
 RbNode*		rbInsert(RbTree *tree, const uint32_t key);
 
-/* delete node from tree (ideally one that *is* in the tree...) */
+/*
+ * insert key next to a hint node already in the tree (e.g. the last one inserted): amortised O(1) when the key belongs
+ * beside the hint, a wrong hint costs a finger search from it. NULL hint is rbInsert(), returns NULL for intrusive trees
+ */
+RbNode*		rbInsertHint(RbTree *tree, RbNode *hint, const uint32_t key);
+
+/* link a caller-owned node with its key set into an intrusive tree, returns the node or the existing node with the same key */
+RbNode*		rbInsertNode(RbTree *tree, RbNode *node);
+
+/* unlink a node from an intrusive tree without freeing it, returns the node (NULL for other trees) */
+RbNode*		rbRemoveNode(RbTree *tree, RbNode *node);
+
+/*
+ * priority queue use: unlink the node with the lowest / highest key and return it, NULL if the tree is empty. No search:
+ * the node is always at hand and has one child at most. The node belongs to the caller until released with rbFreeNode()
+ */
+RbNode*		rbPopMin(RbTree *tree);
+RbNode*		rbPopMax(RbTree *tree);
+
+/* release a node unlinked by rbPopMin() / rbPopMax(), with its preallocated value - nothing to do in an intrusive tree */
+void		rbFreeNode(RbTree *tree, RbNode *node);
+
+/* delete node from tree (ideally one that *is* in the tree...) - intrusive trees only unlink it */
 void		rbDeleteNode(RbTree *tree, RbNode *node);
 
 /* delete node with given key from tree */
 void		rbDeleteKey(RbTree *tree, const uint32_t key);
 
+/*
+ * insert / delete a batch of keys in any order, duplicates allowed, with the same result as rbInsert() / rbDeleteKey()
+ * on each key. The batch is radix sorted and applied in key order, every key starting from the previous key's node
+ * instead of the root - or, for batches of 1 / RB_BATCH_REBUILD of the tree size and up, merged with the tree into a
+ * freshly balanced one. Existing nodes are relinked, never moved. Return the number of keys actually inserted / deleted;
+ * rbInsertBatch() does nothing in an intrusive tree
+ */
+uint32_t	rbInsertBatch(RbTree *tree, const uint32_t *keys, const uint32_t count);
+uint32_t	rbDeleteBatch(RbTree *tree, const uint32_t *keys, const uint32_t count);
+
+/*
+ * delete all keys in range (same range qualifiers as rbInOrderRange()) in O(log n + k) for k keys: the range is split
+ * off the tree and the rest joined back, no per-key search or rebalancing. freeCallback (NULL for none) is run on each
+ * node as it leaves, links cleared, before it is freed - for values the tree does not own, or to take back intrusive
+ * nodes. Returns the number of keys deleted
+ */
+uint32_t	rbDeleteRange(RbTree *tree, const uint32_t low, const int lowqual, const uint32_t high, const int highqual,
+			void (*freeCallback) (RbNode *node));
+
+/*
+ * split and join: nodes move between trees in O(log n), nothing is copied. Trees taking part must be alike - same flags,
+ * value size and free callback - with nodes from an allocator both can release to: malloc, the thread's shared pool,
+ * a pool shared since a split, or a private pool the receiving tree can take over. Without RBT_ORDSTAT, the parts of a
+ * split are left uncounted (see rbCount()). Trees with a hash index or filter index the keys that moved in: a split
+ * takes O(log n + k) for the smaller part of k keys, which is counted, a join O(log n + k) for the k keys joined in
+ */
+/*
+ * join low, a new node with key, and high into low, leaving high empty. Returns low, or NULL with both trees untouched if
+ * keys in low are not all below key and keys in high all above it, or if the trees are not alike. Not for intrusive
+ * trees, which have no node to give the key - neither is rbConcat(), to match: put split intrusive trees back together
+ * with rbUnion()
+ */
+RbTree*		rbJoin(RbTree *low, const uint32_t key, RbTree *high);
+/* same without a new node: all keys in low must be below all keys in high */
+RbTree*		rbConcat(RbTree *low, RbTree *high);
+/*
+ * split tree in two: *low is the tree itself with keys below key, *high a new tree alike with the rest (free with rbFree()).
+ * A private pool or arena is shared by both parts, which gives up the O(1) rbEmpty() until the other part is freed
+ */
+void		rbSplit(RbTree *tree, const uint32_t key, RbTree **low, RbTree **high);
+
+/*
+ * set algebra by join-based divide and conquer: b's root splits a, the halves are dealt with separately - in parallel on
+ * a thread pool for big trees - and joined back, in O(m log(n / m + 1)) work for m <= n keys. In place: the result is left
+ * in a and b is left empty, nodes left out are freed (unlinked in intrusive trees), and a's node is kept for a key found
+ * in both. Trees must be alike as for rbJoin(): returns a, or NULL with both trees untouched. Trees with a hash index or
+ * filter also index the keys that moved in
+ */
+RbTree*		rbUnion(RbTree *a, RbTree *b);
+RbTree*		rbIntersect(RbTree *a, RbTree *b);
+/* keys in a that are not in b */
+RbTree*		rbDifference(RbTree *a, RbTree *b);
+
+/*
+ * non-destructive versions: the result is a new tree like a, made from copies of both trees - O(n + m). Values are copied
+ * as they are, so trees with a free callback (and intrusive trees) are refused with NULL
+ */
+RbTree*		rbUnionCopy(RbTree *a, RbTree *b);
+RbTree*		rbIntersectCopy(RbTree *a, RbTree *b);
+RbTree*		rbDifferenceCopy(RbTree *a, RbTree *b);
+
+/*
+ * run set operations on this many threads (0 = one per online CPU, the default; 1 = no pool): the current pool stops,
+ * once set operations running on it in other threads are done
+ */
+void		rbSetThreads(const unsigned int threads);
+
 /* in-order traversal, dir = RB_ASC | RB_DESC, running specified callback function on each node */
 void		rbInOrderTrack(RbTree *tree, RbCallback callback, void *user, const int dir);
 /*
@@ -124,6 +429,24 @@ void		rbInOrderTrack(RbTree *tree, RbCallback callback, void *user, const int di
 uint32_t	rbInOrderRangeTrack(RbTree *tree, RbCallback callback, void *user, const int dir,
 			const uint32_t low, const int lowqual, const uint32_t high, const int highqual);
 
+/* node with the lowest / highest key in O(1), kept in the tree container, NULL if empty */
+RbNode*		rbMin(RbTree *tree);
+RbNode*		rbMax(RbTree *tree);
+
+/* iteration over parent links: no allocation, amortised O(1) per step, NULL past either end. rbFirst() / rbLast() are O(1) */
+RbNode*		rbFirst(RbTree *tree);
+RbNode*		rbLast(RbTree *tree);
+RbNode*		rbNext(RbNode *node);
+RbNode*		rbPrev(RbNode *node);
+
+/*
+ * versions of rbInOrder() / rbInOrderRange() that allocate nothing, best for short scans: the traversal path lives in a
+ * fixed-size array on the C stack. Same callback type, with bh and height always 0
+ */
+void		rbIterate(RbTree *tree, RbCallback callback, void *user, const int dir);
+uint32_t	rbIterateRange(RbTree *tree, RbCallback callback, void *user, const int dir,
+			const uint32_t low, const int lowqual, const uint32_t high, const int highqual);
+
 /* "fast" versions do away with black height / height calculation - but maintain same callback type */
 void		rbInOrder(RbTree *tree, RbCallback callback, void *user, const int dir);
 uint32_t	rbInOrderRange(RbTree *tree, RbCallback callback, void *user, const int dir,
@@ -0,0 +1,257 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   rbt_dict.c
+ * @date   Fri Oct 16 18:10:00 2026
+ *
+ * @brief  string-keyed dictionary. Keys are ordered by (hash, length, first 8 bytes, rest of key):
+ *         a lookup descending the tree almost always settles each comparison on the cached hash,
+ *         equal-hash collisions are told apart inside the tree by length and prefix, and the full
+ *         key is only compared once everything cached matches - once on a hit.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "xalloc.h"
+#include "rbt_generic.h"
+#include "rbt_dict.h"
+
+/* dictionary key: hash, length and prefix are compared first, the full key only when they all match */
+typedef struct {
+    uint32_t hash;
+    uint32_t len;
+    uint64_t prefix; /* first 8 bytes of the key, zero padded */
+    const char *str; /* owned by the dictionary once inserted */
+} RbdKey;
+
+/* the comparator, inlined into the generated tree */
+static inline int rbdKeyCmp(const RbdKey a, const RbdKey b) {
+
+    if(a.hash != b.hash) {
+	return RBT_CMP_NUM(a.hash, b.hash);
+    }
+
+    if(a.len != b.len) {
+	return RBT_CMP_NUM(a.len, b.len);
+    }
+
+    if(a.prefix != b.prefix) {
+	return RBT_CMP_NUM(a.prefix, b.prefix);
+    }
+
+    /* everything cached matches: only now look at the rest of the key */
+    return (a.len > sizeof(a.prefix)) ? memcmp(a.str + sizeof(a.prefix), b.str + sizeof(b.prefix), a.len - sizeof(a.prefix)) : 0;
+
+}
+
+RBT_DEFINE(rbdt, RbdKey, rbdKeyCmp)
+
+struct RbDict {
+    rbdtTree *tree;
+    void (*freeCallback) (void *value);
+};
+
+/* traversal state for rbdForEach() */
+typedef struct {
+    RbdCallback callback;
+    void *user;
+} RbdForEachState;
+
+/* 32-bit FNV-1a */
+static inline uint32_t rbdHash(const char *key, const size_t len) {
+
+    uint32_t ret = 2166136261U;
+    size_t i;
+
+    for(i = 0; i < len; i++) {
+	ret ^= (uint8_t)key[i];
+	ret *= 16777619U;
+    }
+
+    return ret;
+
+}
+
+/* build a lookup key pointing at the caller's string */
+static inline RbdKey rbdKey(const char *key, const size_t len) {
+
+    RbdKey ret;
+
+    ret.hash = rbdHash(key, len);
+    ret.len = len;
+    ret.prefix = 0;
+    memcpy(&ret.prefix, key, (len < sizeof(ret.prefix)) ? len : sizeof(ret.prefix));
+    ret.str = key;
+
+    return ret;
+
+}
+
+/* release an entry's key copy and value */
+static inline void rbdRelease(RbDict *dict, rbdtNode *node) {
+
+    if(dict->freeCallback != NULL) {
+	dict->freeCallback(node->value);
+    }
+
+    free((char*)node->key.str);
+
+}
+
+/* callback releasing every entry before the tree is emptied */
+static void rbdReleaseCallback(rbdtTree *tree, rbdtNode *node, void *user, bool *cont, const uint32_t nodenumber) {
+
+    rbdRelease(user, node);
+
+}
+
+/* callback adapting generic tree traversal to rbdForEach() */
+static void rbdForEachCallback(rbdtTree *tree, rbdtNode *node, void *user, bool *cont, const uint32_t nodenumber) {
+
+    RbdForEachState *state = user;
+
+    state->callback(node->key.str, node->key.len, &node->value, state->user, cont);
+
+}
+
+/* create a dictionary */
+RbDict* rbdCreate(void (*freeCallback) (void *value)) {
+
+    RbDict *ret;
+
+    xcalloc(ret, 1, sizeof(RbDict));
+    ret->tree = rbdtCreate();
+    ret->freeCallback = freeCallback;
+
+    return ret;
+
+}
+
+/* search for key */
+void** rbdSearch(RbDict *dict, const char *key, const size_t len) {
+
+    rbdtNode *node;
+
+    if(len > UINT32_MAX) {
+	return NULL;
+    }
+
+    node = rbdtSearch(dict->tree, rbdKey(key, len));
+
+    return (node == NULL) ? NULL : &node->value;
+
+}
+
+/* insert a copy of key */
+void** rbdInsert(RbDict *dict, const char *key, const size_t len) {
+
+    rbdtNode *node;
+    uint32_t count = dict->tree->count;
+    char *copy;
+
+    if(len > UINT32_MAX) {
+	return NULL;
+    }
+
+    node = rbdtInsert(dict->tree, rbdKey(key, len));
+
+    /* new entry: the node still points at the caller's key, give it its own copy */
+    if(dict->tree->count != count) {
+	xmalloc(copy, len + 1);
+	memcpy(copy, key, len);
+	copy[len] = '\0';
+	node->key.str = copy;
+    }
+
+    return &node->value;
+
+}
+
+/* delete key */
+bool rbdDelete(RbDict *dict, const char *key, const size_t len) {
+
+    rbdtNode *node;
+
+    if(len > UINT32_MAX) {
+	return false;
+    }
+
+    node = rbdtSearch(dict->tree, rbdKey(key, len));
+
+    if(node == NULL) {
+	return false;
+    }
+
+    rbdRelease(dict, node);
+    rbdtDeleteNode(dict->tree, node);
+
+    return true;
+
+}
+
+/* traverse all entries */
+void rbdForEach(RbDict *dict, RbdCallback callback, void *user) {
+
+    RbdForEachState state = { callback, user };
+
+    rbdtInOrder(dict->tree, rbdForEachCallback, &state, RB_ASC);
+
+}
+
+/* number of entries */
+uint32_t rbdCount(RbDict *dict) {
+
+    return dict->tree->count;
+
+}
+
+/* free entries and dictionary */
+void rbdFree(RbDict *dict) {
+
+    if(dict != NULL) {
+	rbdEmpty(dict);
+	rbdtFree(dict->tree);
+	free(dict);
+    }
+
+}
+
+/* just free entries */
+void rbdEmpty(RbDict *dict) {
+
+    if(dict != NULL) {
+	rbdtInOrder(dict->tree, rbdReleaseCallback, dict, RB_ASC);
+	rbdtEmpty(dict->tree);
+    }
+
+}
@@ -0,0 +1,75 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   rbt_dict.h
+ * @date   Fri Oct 16 18:10:00 2026
+ *
+ * @brief  string-keyed dictionary on top of a generic red-black tree: nodes cache a 32-bit hash,
+ *         the key length and the first 8 bytes of the key, so that mismatches are settled without
+ *         touching the full key, and a hit costs at most one memcmp()
+ *
+ */
+
+#ifndef RBT_DICT_H_
+#define RBT_DICT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* dictionary container, see rbt_dict.c */
+typedef struct RbDict RbDict;
+
+/* traversal callback: key, key length, pointer to the value slot, user data, set *cont to false to stop */
+typedef void (*RbdCallback) (const char *key, const size_t len, void **value, void *user, bool *cont);
+
+/* create an empty dictionary, freeCallback (can be NULL) is called on values of deleted entries, and on all values when emptied */
+RbDict*		rbdCreate(void (*freeCallback) (void *value));
+
+/* search for key of given length, return pointer to its value slot or NULL if not found */
+void**		rbdSearch(RbDict *dict, const char *key, const size_t len);
+
+/* insert a copy of key of given length, return pointer to its value slot: NULL for a new key, existing value otherwise */
+void**		rbdInsert(RbDict *dict, const char *key, const size_t len);
+
+/* delete key of given length, return false if not found */
+bool		rbdDelete(RbDict *dict, const char *key, const size_t len);
+
+/* traverse all entries in tree order: by key hash (then length and prefix), which is stable but not lexical order */
+void		rbdForEach(RbDict *dict, RbdCallback callback, void *user);
+
+/* number of entries */
+uint32_t	rbdCount(RbDict *dict);
+
+/* free entries and dictionary */
+void		rbdFree(RbDict *dict);
+
+/* just free entries */
+void		rbdEmpty(RbDict *dict);
+
+#endif /* RBT_DICT_H_ */
@@ -86,7 +86,7 @@ static void rbDisplayNode(RbNode *node, char *buf, const int x, const int y, con
 	    putPos(buf, tmp, x, y, maxwidth, maxheight);
 	}
     } else {
-	snprintf(tmp, 50, "%s%u", node->red ? "R" : "B", node->key);
+	snprintf(tmp, 50, "%s%u", rbGetRed(node) ? "R" : "B", node->key);
 	putPos(buf, tmp, x, y, maxwidth, maxheight);
     }
 
@@ -0,0 +1,241 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   rbt_freeze.c
+ * @date   Fri Oct 16 15:10:00 2026
+ *
+ * @brief  frozen red-black tree snapshots. The snapshot is an implicit binary search tree in BFS
+ *         (Eytzinger) order: the top levels of every search share a handful of cache lines, there
+ *         are no pointers to chase, and the descent is a branchless compare-and-shift loop that
+ *         prefetches four levels ahead.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "xalloc.h"
+#include "rbt_freeze.h"
+
+/* cache line size, and how many keys down the descent we prefetch: 16 keys = 4 levels = one line */
+#define RBF_LINE 64
+#define RBF_PREFETCH (RBF_LINE / sizeof(uint32_t))
+
+/* position of the first (smallest) key */
+static inline uint32_t rbfFirst(const RbFrozen *frozen) {
+
+    uint32_t pos = RBF_NONE;
+
+    if(frozen->count > 0) {
+	for(pos = 1; 2 * pos <= frozen->count; pos *= 2);
+    }
+
+    return pos;
+
+}
+
+/* build state: the snapshot being filled and the next position in key order */
+typedef struct {
+    RbFrozen *frozen;
+    uint32_t pos;
+} RbfBuildState;
+
+/* in-order callback filling the snapshot */
+static RbNode* rbfBuildCallback(RbTree *tree, RbNode *node, void *user, const int bh, const int height, bool *cont, const uint32_t nodenumber) {
+
+    RbfBuildState *state = user;
+
+    state->frozen->keys[state->pos] = node->key;
+#ifndef RBT_SET
+    state->frozen->values[state->pos] = node->value;
+#endif /* RBT_SET */
+    state->pos = rbfNext(state->frozen, state->pos);
+
+    return node;
+
+}
+
+/* build a frozen snapshot of the tree */
+RbFrozen* rbFreeze(RbTree *tree) {
+
+    RbFrozen *ret;
+    RbfBuildState state;
+
+    if(tree == NULL) {
+	return NULL;
+    }
+
+    xcalloc(ret, 1, sizeof(RbFrozen));
+    ret->count = rbCount(tree);
+
+    /* slot 0 is the unused sentinel; keys[] starts on a cache line boundary */
+    xmalloc(ret->mem, (ret->count + 1) * sizeof(uint32_t) + RBF_LINE);
+    ret->keys = (uint32_t*)(((uintptr_t)ret->mem + RBF_LINE - 1) & ~(uintptr_t)(RBF_LINE - 1));
+    ret->keys[RBF_NONE] = 0;
+#ifndef RBT_SET
+    xmalloc(ret->values, (ret->count + 1) * sizeof(void*));
+    ret->values[RBF_NONE] = NULL;
+#endif /* RBT_SET */
+
+    /* an in-order walk visits keys in ascending order, which is the in-order sequence of the implicit tree */
+    state.frozen = ret;
+    state.pos = rbfFirst(ret);
+    rbInOrder(tree, rbfBuildCallback, &state, RB_ASC);
+
+    if(tree->filter != NULL) {
+	rbfFilterEnable(ret);
+    }
+
+    return ret;
+
+}
+
+/* position of the smallest key >= key */
+uint32_t rbfLowerBound(const RbFrozen *frozen, const uint32_t key) {
+
+    const uint32_t *keys = frozen->keys;
+    const uint32_t count = frozen->count;
+    uint32_t pos = 1;
+
+    /* no branching on the comparison: go left or right by adding its result */
+    while(pos <= count) {
+	__builtin_prefetch(keys + RBF_PREFETCH * pos);
+	pos = 2 * pos + (keys[pos] < key);
+    }
+
+    /* every right turn was a key < key: undo the trailing right turns and the last left turn */
+    pos >>= __builtin_ffs(~pos);
+
+    return pos;
+
+}
+
+/* position of key */
+uint32_t rbfSearch(const RbFrozen *frozen, const uint32_t key) {
+
+    uint32_t pos;
+
+    if(frozen->filter != NULL && !kfXorQuery(frozen->filter, key)) {
+	return RBF_NONE;
+    }
+
+    pos = rbfLowerBound(frozen, key);
+
+    /* no need to test for RBF_NONE: a sentinel match still returns RBF_NONE */
+    return (frozen->keys[pos] == key) ? pos : RBF_NONE;
+
+}
+
+/* build the xor filter */
+bool rbfFilterEnable(RbFrozen *frozen) {
+
+    if(frozen->filter == NULL) {
+	/* keys in a snapshot are distinct, so this only fails in the unlikely event of running out of hash seeds */
+	frozen->filter = kfXorBuild(frozen->keys + 1, frozen->count);
+    }
+
+    return frozen->filter != NULL;
+
+}
+
+/* position of the next key in ascending order */
+uint32_t rbfNext(const RbFrozen *frozen, uint32_t pos) {
+
+    /* right child, then left all the way */
+    if(2 * pos + 1 <= frozen->count) {
+	for(pos = 2 * pos + 1; 2 * pos <= frozen->count; pos *= 2);
+	return pos;
+    }
+
+    /* up while we are a right child, then once more */
+    while(pos & 1) {
+	pos >>= 1;
+    }
+
+    return pos >> 1;
+
+}
+
+/* ascending range scan */
+uint32_t rbfRange(const RbFrozen *frozen, RbfCallback callback, void *user,
+			const uint32_t low, const int lowqual, const uint32_t high, const int highqual) {
+
+    uint32_t count = 0;
+    uint32_t pos;
+    bool cont = true;
+
+    if(frozen == NULL) {
+	return 0;
+    }
+
+    pos = (lowqual == RB_INF) ? rbfFirst(frozen) : rbfLowerBound(frozen, low);
+
+    if(lowqual == RB_EXCL && pos != RBF_NONE && frozen->keys[pos] == low) {
+	pos = rbfNext(frozen, pos);
+    }
+
+    while(cont && pos != RBF_NONE) {
+
+	uint32_t key = frozen->keys[pos];
+
+	if(highqual != RB_INF && (key > high || (highqual == RB_EXCL && key == high))) {
+	    break;
+	}
+
+	count++;
+
+	if(callback != NULL) {
+#ifdef RBT_SET
+	    callback(key, NULL, user, &cont);
+#else
+	    callback(key, frozen->values[pos], user, &cont);
+#endif /* RBT_SET */
+	}
+
+	pos = rbfNext(frozen, pos);
+
+    }
+
+    return count;
+
+}
+
+/* free the snapshot */
+void rbfFree(RbFrozen *frozen) {
+
+    if(frozen != NULL) {
+#ifndef RBT_SET
+	free(frozen->values);
+#endif /* RBT_SET */
+	free(frozen->mem);
+	kfXorFree(frozen->filter);
+	free(frozen);
+    }
+
+}
@@ -0,0 +1,98 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   rbt_freeze.h
+ * @date   Fri Oct 16 15:10:00 2026
+ *
+ * @brief  frozen (read-only) red-black tree snapshots: keys laid out in BFS (Eytzinger) order
+ *         in one flat, pointer-free array, searched without branching on key comparisons
+ *
+ */
+
+#ifndef RBT_FREEZE_H_
+#define RBT_FREEZE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* RbTree, RB_INCL / RB_EXCL / RB_INF */
+#include "rbt.h"
+#include "kf.h"
+
+/* the "no entry" position - slot 0 is never used, the first key lives in slot 1 */
+#define RBF_NONE 0
+
+/*
+ * a frozen snapshot: key at position i has children at 2i and 2i + 1. Positions are 1-based,
+ * keys[] is aligned so that the 16 keys of any four levels down from a node share one cache line
+ */
+typedef struct {
+    uint32_t *keys;
+#ifndef RBT_SET
+    void **values; /* each node's value slot, as is: values are not copied and still belong to the source tree */
+#endif /* RBT_SET */
+    uint32_t count;
+    void *mem; /* allocation behind keys[] */
+    KfXor *filter; /* negative lookup filter consulted by rbfSearch(), NULL if not built */
+} RbFrozen;
+
+/* range scan callback: key, value (NULL in a RBT_SET build), user data, set *cont to false to stop */
+typedef void (*RbfCallback) (const uint32_t key, void *value, void *user, bool *cont);
+
+/* key and value at a valid position */
+#define rbfKey(frozen, pos) ((frozen)->keys[(pos)])
+#ifndef RBT_SET
+#define rbfValue(frozen, pos) ((frozen)->values[(pos)])
+#endif /* RBT_SET */
+
+/*
+ * build a frozen snapshot of the tree in O(n), the tree itself is not modified. If the tree has a negative lookup filter,
+ * the snapshot gets one too, rebuilt as an xor filter: smaller than a Bloom filter, but it cannot take updates
+ */
+RbFrozen*	rbFreeze(RbTree *tree);
+
+/* position of key, RBF_NONE if not found */
+uint32_t	rbfSearch(const RbFrozen *frozen, const uint32_t key);
+
+/* build the snapshot's xor filter so that rbfSearch() settles most misses without a descent, returns false on failure */
+bool		rbfFilterEnable(RbFrozen *frozen);
+
+/* position of the smallest key >= key, RBF_NONE if there is none */
+uint32_t	rbfLowerBound(const RbFrozen *frozen, const uint32_t key);
+
+/* position of the next key in ascending order, RBF_NONE after the last one */
+uint32_t	rbfNext(const RbFrozen *frozen, uint32_t pos);
+
+/* ascending range scan with the same range qualifiers as rbInOrderRange(), returns the number of keys within range */
+uint32_t	rbfRange(const RbFrozen *frozen, RbfCallback callback, void *user,
+			const uint32_t low, const int lowqual, const uint32_t high, const int highqual);
+
+/* free the snapshot */
+void		rbfFree(RbFrozen *frozen);
+
+#endif /* RBT_FREEZE_H_ */
@@ -0,0 +1,560 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   rbt_generic.h
+ * @date   Fri Oct 16 17:20:00 2026
+ *
+ * @brief  type-generic red-black trees implemented as macros only: RBT_DEFINE(name, keytype, cmp)
+ *         emits a complete tree specialised for one key type, with the comparator inlined
+ *
+ */
+
+#ifndef RBT_GENERIC_H_
+#define RBT_GENERIC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "xalloc.h"
+
+/* shared constants: RB_ASC, RB_LEFT, RB_INCL and friends */
+#include "rbt.h"
+
+/*
+ * usage: RBT_DEFINE(rb64, uint64_t, RBT_CMP_NUM) at file scope gives types rb64Node, rb64Tree, rb64Callback
+ * and functions rb64Create, rb64Search, rb64Insert, rb64DeleteNode, rb64DeleteKey, rb64First, rb64Next,
+ * rb64Seek, rb64InOrder, rb64InOrderRange, rb64Verify, rb64Empty and rb64Free, all static inline.
+ *
+ * cmp(a, b) is a function or macro returning < 0, 0 or > 0 as a is lower than, equal to or greater than b;
+ * keys are passed and stored by value. Nodes keep parent links, so traversal needs no stack, and the
+ * in-order callback can stop the traversal but must not free nodes.
+ */
+
+/* comparator for any scalar key type */
+#define RBT_CMP_NUM(a, b) (((a) > (b)) - ((a) < (b)))
+
+/* 128-bit key (UUIDs and such), compared as an unsigned 128-bit number */
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} RbKey128;
+
+static inline int rbKey128Cmp(const RbKey128 a, const RbKey128 b) {
+
+    return (a.hi != b.hi) ? RBT_CMP_NUM(a.hi, b.hi) : RBT_CMP_NUM(a.lo, b.lo);
+
+}
+
+/* node helpers shared by all generated trees */
+#define RBT_G_RED(var) ((var) != NULL && (var)->red)
+#define RBT_G_DIR(var) ((var) == (var)->parent->children[RB_RIGHT])
+
+/* emit a tree for given name prefix, key type and comparator */
+#define RBT_DEFINE(name, keytype, cmp) \
+typedef struct name##Node name##Node; \
+\
+struct name##Node { \
+    name##Node* children[2]; \
+    name##Node* parent; \
+    void* value; \
+    keytype key; \
+    bool red; \
+}; \
+\
+typedef struct { \
+    name##Node *root; \
+    uint32_t count; \
+} name##Tree; \
+\
+/* callback: tree, node, user data, pointer to bool (set to false to stop), node count so far; must not free the node */ \
+typedef void (*name##Callback) (name##Tree*, name##Node*, void*, bool*, const uint32_t); \
+\
+/* create an empty tree */ \
+static inline name##Tree* name##Create() { \
+\
+    name##Tree *ret; \
+\
+    xcalloc(ret, 1, sizeof(name##Tree)); \
+\
+    return ret; \
+\
+} \
+\
+/* search for key, return node or NULL */ \
+static inline name##Node* name##Search(name##Tree *tree, const keytype key) { \
+\
+    name##Node *current = tree->root; \
+\
+    while(current != NULL) { \
+\
+	int c = cmp(key, current->key); \
+\
+	if(c == 0) { \
+	    return current; \
+	} \
+\
+	current = current->children[c > 0]; \
+\
+    } \
+\
+    return NULL; \
+\
+} \
+\
+/* first node in given direction: smallest key for RB_ASC, largest for RB_DESC */ \
+static inline name##Node* name##First(name##Tree *tree, const int dir) { \
+\
+    name##Node *current = tree->root; \
+\
+    if(current != NULL) { \
+	while(current->children[dir] != NULL) { \
+	    current = current->children[dir]; \
+	} \
+    } \
+\
+    return current; \
+\
+} \
+\
+/* next node in given direction, NULL after the last one - no stack, parent links only */ \
+static inline name##Node* name##Next(name##Node *node, const int dir) { \
+\
+    if(node->children[!dir] != NULL) { \
+	node = node->children[!dir]; \
+	while(node->children[dir] != NULL) { \
+	    node = node->children[dir]; \
+	} \
+	return node; \
+    } \
+\
+    while(node->parent != NULL && node == node->parent->children[!dir]) { \
+	node = node->parent; \
+    } \
+\
+    return node->parent; \
+\
+} \
+\
+/* first node in given direction at or past key (RB_INCL), or strictly past it (RB_EXCL) */ \
+static inline name##Node* name##Seek(name##Tree *tree, const keytype key, const int qual, const int dir) { \
+\
+    name##Node *current = tree->root; \
+    name##Node *ret = NULL; \
+\
+    while(current != NULL) { \
+\
+	int c = cmp(current->key, key); \
+\
+	if(dir == RB_DESC) { \
+	    c = -c; \
+	} \
+\
+	/* current qualifies: remember it and look for a closer one */ \
+	if(c > 0 || (c == 0 && qual == RB_INCL)) { \
+	    ret = current; \
+	    current = current->children[dir]; \
+	} else { \
+	    current = current->children[!dir]; \
+	} \
+\
+    } \
+\
+    return ret; \
+\
+} \
+\
+/* rotate subtree at root in given direction */ \
+static inline void name##Rotate(name##Tree *tree, name##Node *root, const int dir) { \
+\
+    name##Node *pivot = root->children[!dir]; \
+\
+    root->children[!dir] = pivot->children[dir]; \
+    if(pivot->children[dir] != NULL) { \
+	pivot->children[dir]->parent = root; \
+    } \
+    pivot->children[dir] = root; \
+    pivot->parent = root->parent; \
+    root->parent = pivot; \
+\
+    if(pivot->parent == NULL) { \
+	tree->root = pivot; \
+    } else { \
+	pivot->parent->children[pivot->parent->children[RB_RIGHT] == root] = pivot; \
+    } \
+\
+} \
+\
+/* insert key, return the new node, or existing node if key exists */ \
+static inline name##Node* name##Insert(name##Tree *tree, const keytype key) { \
+\
+    name##Node *current = tree->root; \
+    name##Node *parent = NULL; \
+    name##Node *ret; \
+    int c = 0; \
+\
+    while(current != NULL) { \
+\
+	c = cmp(key, current->key); \
+\
+	if(c == 0) { \
+	    return current; \
+	} \
+\
+	parent = current; \
+	current = current->children[c > 0]; \
+\
+    } \
+\
+    xmalloc(ret, sizeof(name##Node)); \
+    ret->children[0] = ret->children[1] = NULL; \
+    ret->parent = parent; \
+    ret->value = NULL; \
+    ret->key = key; \
+    ret->red = true; \
+    tree->count++; \
+\
+    if(parent == NULL) { \
+	tree->root = ret; \
+    } else { \
+	parent->children[c > 0] = ret; \
+    } \
+\
+    /* travel upwards and correct red->red violations */ \
+    current = ret; \
+    while(RBT_G_RED(current) && RBT_G_RED(current->parent)) { \
+\
+	name##Node *grandparent; \
+	name##Node *uncle; \
+	int dir; \
+\
+	parent = current->parent; \
+	grandparent = parent->parent; \
+	dir = RBT_G_DIR(parent); \
+	uncle = grandparent->children[!dir]; \
+\
+	if(RBT_G_RED(uncle)) { \
+	    grandparent->red = true; \
+	    parent->red = false; \
+	    uncle->red = false; \
+	    current = grandparent; \
+	} else { \
+	    if(current == parent->children[!dir]) { \
+		name##Rotate(tree, parent, dir); \
+		current = parent; \
+		parent = current->parent; \
+	    } \
+	    name##Rotate(tree, grandparent, !dir); \
+	    parent->red = false; \
+	    grandparent->red = true; \
+	    current = parent; \
+	} \
+\
+    } \
+\
+    tree->root->red = false; \
+\
+    return ret; \
+\
+} \
+\
+/* delete node from tree and free it */ \
+static inline void name##DeleteNode(name##Tree *tree, name##Node *node) { \
+\
+    name##Node *ubparent; \
+    name##Node *promoted; \
+    int dir = 0; \
+\
+    if(node == NULL) { \
+	return; \
+    } \
+\
+    /* two children: swap places with the successor, so that the node has one child at most */ \
+    if(node->children[RB_LEFT] != NULL && node->children[RB_RIGHT] != NULL) { \
+\
+	name##Node *successor = node->children[RB_RIGHT]; \
+	name##Node *parent = node->parent; \
+	name##Node *sright; \
+	bool red = node->red; \
+\
+	while(successor->children[RB_LEFT] != NULL) { \
+	    successor = successor->children[RB_LEFT]; \
+	} \
+\
+	sright = successor->children[RB_RIGHT]; \
+\
+	successor->children[RB_LEFT] = node->children[RB_LEFT]; \
+	successor->children[RB_LEFT]->parent = successor; \
+\
+	if(successor->parent == node) { \
+	    successor->children[RB_RIGHT] = node; \
+	    node->parent = successor; \
+	} else { \
+	    successor->children[RB_RIGHT] = node->children[RB_RIGHT]; \
+	    successor->children[RB_RIGHT]->parent = successor; \
+	    successor->parent->children[RB_LEFT] = node; \
+	    node->parent = successor->parent; \
+	} \
+\
+	successor->parent = parent; \
+	if(parent == NULL) { \
+	    tree->root = successor; \
+	} else { \
+	    parent->children[parent->children[RB_RIGHT] == node] = successor; \
+	} \
+\
+	node->children[RB_LEFT] = NULL; \
+	node->children[RB_RIGHT] = sright; \
+	if(sright != NULL) { \
+	    sright->parent = node; \
+	} \
+\
+	node->red = successor->red; \
+	successor->red = red; \
+\
+    } \
+\
+    promoted = node->children[node->children[RB_LEFT] == NULL]; \
+\
+    if(node->parent == NULL) { \
+	tree->root = promoted; \
+    } else { \
+	dir = RBT_G_DIR(node); \
+	node->parent->children[dir] = promoted; \
+    } \
+\
+    if(promoted != NULL) { \
+	promoted->parent = node->parent; \
+    } \
+\
+    ubparent = node->parent; \
+    tree->count--; \
+\
+    /* node and child differ in colour: the promoted node turns black if needed, done */ \
+    if(node->red != RBT_G_RED(promoted)) { \
+	if(!node->red) { \
+	    promoted->red = false; \
+	} \
+	ubparent = NULL; \
+    } \
+\
+    free(node); \
+\
+    /* rebalance from the parent, tracking the direction of the short side */ \
+    while(ubparent != NULL) { \
+\
+	name##Node *ubsibling = ubparent->children[!dir]; \
+\
+	if(RBT_G_RED(ubsibling)) { \
+\
+	    name##Rotate(tree, ubparent, dir); \
+	    ubparent->red = true; \
+	    ubsibling->red = false; \
+\
+	} else if(RBT_G_RED(ubsibling->children[!dir])) { \
+\
+	    ubsibling->children[!dir]->red = false; \
+	    ubsibling->red = ubparent->red; \
+	    ubparent->red = false; \
+	    name##Rotate(tree, ubparent, dir); \
+	    return; \
+\
+	} else if(RBT_G_RED(ubsibling->children[dir])) { \
+\
+	    ubsibling->children[dir]->red = false; \
+	    ubsibling->red = true; \
+	    name##Rotate(tree, ubsibling, !dir); \
+\
+	} else if(ubparent->red) { \
+\
+	    ubparent->red = false; \
+	    ubsibling->red = true; \
+	    return; \
+\
+	} else { \
+\
+	    ubsibling->red = true; \
+	    if(ubparent->parent != NULL) { \
+		dir = RBT_G_DIR(ubparent); \
+	    } \
+	    ubparent = ubparent->parent; \
+\
+	} \
+\
+    } \
+\
+} \
+\
+/* delete the node with given key */ \
+static inline void name##DeleteKey(name##Tree *tree, const keytype key) { \
+\
+    name##DeleteNode(tree, name##Search(tree, key)); \
+\
+} \
+\
+/* in-order traversal, dir = RB_ASC | RB_DESC */ \
+static inline void name##InOrder(name##Tree *tree, name##Callback callback, void *user, const int dir) { \
+\
+    name##Node *current; \
+    uint32_t nodenumber = 0; \
+    bool cont = true; \
+\
+    for(current = name##First(tree, dir); cont && current != NULL; current = name##Next(current, dir)) { \
+	callback(tree, current, user, &cont, nodenumber++); \
+    } \
+\
+} \
+\
+/* range traversal with the same range qualifiers as rbInOrderRange(), returns the number of nodes within range */ \
+static inline uint32_t name##InOrderRange(name##Tree *tree, name##Callback callback, void *user, const int dir, \
+			const keytype low, const int lowqual, const keytype high, const int highqual) { \
+\
+    name##Node *current; \
+    uint32_t nodenumber = 0; \
+    bool cont = true; \
+    /* start and end limits, swapped for descending order */ \
+    const keytype *to = (dir == RB_ASC) ? &high : &low; \
+    int fromqual = (dir == RB_ASC) ? lowqual : highqual; \
+    int toqual = (dir == RB_ASC) ? highqual : lowqual; \
+\
+    if(fromqual == RB_INF) { \
+	current = name##First(tree, dir); \
+    } else { \
+	current = name##Seek(tree, (dir == RB_ASC) ? low : high, fromqual, dir); \
+    } \
+\
+    while(cont && current != NULL) { \
+\
+	if(toqual != RB_INF) { \
+	    int c = cmp(current->key, *to); \
+	    if(dir == RB_DESC) { \
+		c = -c; \
+	    } \
+	    if(c > 0 || (c == 0 && toqual == RB_EXCL)) { \
+		break; \
+	    } \
+	} \
+\
+	if(callback != NULL) { \
+	    callback(tree, current, user, &cont, nodenumber); \
+	} \
+	nodenumber++; \
+\
+	current = name##Next(current, dir); \
+\
+    } \
+\
+    return nodenumber; \
+\
+} \
+\
+/* verify red-black tree invariants and key order */ \
+static inline bool name##Verify(name##Tree *tree) { \
+\
+    name##Node *current, *tmp, *last = NULL; \
+    int maxbh = -1; \
+    uint32_t count = 0; \
+\
+    if(RBT_G_RED(tree->root)) { \
+	return false; \
+    } \
+\
+    for(current = name##First(tree, RB_ASC); current != NULL; current = name##Next(current, RB_ASC)) { \
+\
+	count++; \
+\
+	if(last != NULL && cmp(last->key, current->key) >= 0) { \
+	    return false; \
+	} \
+\
+	if(current->red && RBT_G_RED(current->parent)) { \
+	    return false; \
+	} \
+\
+	/* every path ends below a node missing a child: they all must see the same number of black nodes */ \
+	if(current->children[RB_LEFT] == NULL || current->children[RB_RIGHT] == NULL) { \
+\
+	    int bh = 0; \
+\
+	    for(tmp = current; tmp != NULL; tmp = tmp->parent) { \
+		bh += !tmp->red; \
+	    } \
+\
+	    if(maxbh >= 0 && bh != maxbh) { \
+		return false; \
+	    } \
+	    maxbh = bh; \
+\
+	} \
+\
+	last = current; \
+\
+    } \
+\
+    return count == tree->count; \
+\
+} \
+\
+/* just free nodes - bottom-up, without a stack */ \
+static inline void name##Empty(name##Tree *tree) { \
+\
+    name##Node *current = tree->root; \
+\
+    while(current != NULL) { \
+\
+	if(current->children[RB_LEFT] != NULL) { \
+	    current = current->children[RB_LEFT]; \
+	} else if(current->children[RB_RIGHT] != NULL) { \
+	    current = current->children[RB_RIGHT]; \
+	} else { \
+	    name##Node *parent = current->parent; \
+	    if(parent != NULL) { \
+		parent->children[parent->children[RB_RIGHT] == current] = NULL; \
+	    } \
+	    free(current); \
+	    current = parent; \
+	} \
+\
+    } \
+\
+    tree->root = NULL; \
+    tree->count = 0; \
+\
+} \
+\
+/* free tree nodes and tree */ \
+static inline void name##Free(name##Tree *tree) { \
+\
+    if(tree != NULL) { \
+	name##Empty(tree); \
+	free(tree); \
+    } \
+\
+}
+
+#endif /* RBT_GENERIC_H_ */
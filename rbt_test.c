@@ -46,12 +46,35 @@
 #include <time.h>
 #include "rbt.h"
 #include "rbt_display.h"
+#include "irbt.h"
+#include "rbt_freeze.h"
+#include "btree.h"
+#include "rbt_generic.h"
+#include "rbt_dict.h"
 
 /* constants */
 #define TESTSIZE 1000
 #define KEEPSIZE 20
 #define HSIZE 80
 #define VSIZE 20
+/* keys per rbSearchBatch() call, as a request handler would have them */
+#define BATCHSIZE 64
+/* smallest tree in the batch search size sweep */
+#define SWEEPSIZE 1024
+/* number of batches in the batch insertion test */
+#define BATCHUPDATES 16
+/* number of split / join round trips */
+#define SPLITS 64
+/* keys per third of the set operation check: a and b take two thirds each, enough to fork */
+#define SETCHECKSIZE (2 * RB_SET_GRAIN)
+/* threads for the multi-threaded run of the set operation check */
+#define SETTHREADS 4
+/* nodes per short range scan */
+#define SCANSIZE 20
+/* skewed lookups: number of hot keys, percentage of lookups going to them, and hot key cache slots */
+#define HOTSIZE 4096
+#define HOTSHARE 90
+#define CACHESIZE 8192
 
 /* basic duration measurement macros */
 #define DUR_INIT(name) unsigned long long name##_delta; struct timespec name##_t1, name##_t2;
@@ -60,15 +83,39 @@
 #define DUR_PRINT(name, msg) fprintf(stderr, "%s: %llu ns\n", msg, name##_delta);
 #define DUR_EPRINT(name, msg) DUR_END(name); fprintf(stderr, "%s: %llu ns\n", msg, name##_delta);
 
+enum {
+	ALLOC_MALLOC,
+	ALLOC_POOL,
+	ALLOC_POOL_TLS,
+	ALLOC_ARENA
+};
+
 enum {
 	BENCH_NONE,
 	BENCH_INSERT,
 	BENCH_REMOVE,
 	BENCH_SEARCH,
 	BENCH_INC_SEARCH,
-	BENCH_DEC_SEARCH
+	BENCH_DEC_SEARCH,
+	BENCH_BATCH_SEARCH
 };
 
+/* 64-bit keyed tree */
+RBT_DEFINE(rb64, uint64_t, RBT_CMP_NUM)
+
+/* spread a test key over 64 bits */
+#define KEY64(key) (((uint64_t)(key) << 32) | (key))
+
+/* string key buffer size, and the string form of a test key */
+#define SKEYSIZE 24
+#define SKEY(buf, key) snprintf((buf), SKEYSIZE, "dictionary/key/%u", (key))
+
+/* a user record with an embedded tree node, for intrusive tree tests */
+typedef struct {
+    uint32_t payload;
+    RbNode node;
+} TestRecord;
+
 /* generate a Fisher-Yates shuffled array of n uint32s */
 static uint32_t* randArrayU32(const int count) {
 
@@ -97,11 +144,35 @@ static uint32_t* randArrayU32(const int count) {
 
 }
 
+/* create a tree using the selected node allocation mode, preallocating values if valuesize > 0 */
+static RbTree* createTree(const int allocmode, const size_t valuesize) {
+
+    unsigned int flags = (valuesize > 0) ? RB_PREALLOC : 0;
+
+    switch(allocmode) {
+	case ALLOC_POOL:
+	    flags |= RB_POOL;
+	    break;
+	case ALLOC_POOL_TLS:
+	    flags |= RB_POOL_TLS;
+	    break;
+	case ALLOC_ARENA:
+	    flags |= RB_ARENA;
+	    break;
+	case ALLOC_MALLOC:
+	default:
+	    break;
+    }
+
+    return rbCreateExt(flags, valuesize, NULL);
+
+}
+
 static void usage() {
 
     fprintf(stderr, "rbt_test (c) 2018: Wojciech Owczarek, a simple red-black tree implementation\n\n"
 	   "usage: rbt_test [-w NUMBER] [-H NUMBER] [-n NUMBER] [-r NUMBER] [-b NUMBER]\n"
-	   "                [-s] [-m] [-e] [-l] [-o] [-i NUMBER]\n"
+	   "                [-s] [-m] [-e] [-l] [-o] [-c] [-i NUMBER] [-a MODE] [-v NUMBER]\n"
 	   "\n"
 	   "-w NUMBER       Width of text block displaying the final tree, default %d\n"
 	   "-H NUMBER       Height of text block displaying the final tree, default %d\n"
@@ -113,9 +184,15 @@ static void usage() {
 	   "-e              Test search only, CSV output to stdout\n"
 	   "-l              Test incremental search only (during insertion), CSV output to stdout\n"
 	   "-o              Test decremental search only (during removal), CSV output to stdout\n"
+	   "-c              Test scalar vs. batch search on tree sizes doubling from %d up to\n"
+	   "                node count, batches of %d keys, CSV output to stdout\n"
 	   "-i NUMBER       CSV log output interval, default every 1000 nodes,  unless\n"
 	   "                1000 < 1%% node count, then 1%% node count is used.\n"
-	   "\n", HSIZE, VSIZE, TESTSIZE, KEEPSIZE);
+	   "-a MODE         Node allocation mode: malloc (default), pool (per-tree\n"
+	   "                slab pool), tls (pool shared by the thread's trees) or\n"
+	   "                arena (per-tree pool emptied in one go)\n"
+	   "-v NUMBER       Preallocate a value of NUMBER bytes with every node, default 0\n"
+	   "\n", HSIZE, VSIZE, TESTSIZE, KEEPSIZE, SWEEPSIZE, BATCHSIZE);
 
 }
 
@@ -290,6 +367,63 @@ static void runBench(RbTree *tree, const int benchtype, const int testsize, int
 	    fprintf(stderr, "%d found.\n", found);
 
 
+	    break;
+
+	case BENCH_BATCH_SEARCH:
+
+	    found = 0;
+
+	    fprintf(stderr, "Generating CSV output for scalar vs. batch search on trees of up to %d random keys... ", testsize);
+	    fflush(stderr);
+
+	    fprintf(stdout, "node_count,ns_per_search,ns_per_batch_search\n");
+
+	    {
+		uint32_t *larr = malloc(testsize * sizeof(uint32_t));
+		RbNode *out[BATCHSIZE];
+		int size = (testsize < SWEEPSIZE) ? testsize : SWEEPSIZE;
+		int j = 0;
+		unsigned long long scalar_delta;
+
+		while(size > 0) {
+
+		    for(; j < size; j++) {
+			rbInsert(tree, iarr[j]);
+		    }
+
+		    /* a random sample of keys in the tree */
+		    for(i = 0; i < size; i++) {
+			larr[i] = iarr[sarr[i] % size];
+		    }
+
+		    DUR_START(test);
+		    for(i = 0; i < size; i++) {
+			RbNode* n = rbSearch(tree->root, larr[i]);
+
+			if(n != NULL && n->key == larr[i]) {
+			    found++;
+			}
+		    }
+		    DUR_END(test);
+		    scalar_delta = test_delta;
+
+		    DUR_START(test);
+		    for(i = 0; i < size; i += BATCHSIZE) {
+			found += rbSearchBatch(tree, larr + i, (size - i < BATCHSIZE) ? size - i : BATCHSIZE, out);
+		    }
+		    DUR_END(test);
+
+		    fprintf(stdout, "%d,%llu,%llu\n", size, scalar_delta / size, test_delta / size);
+
+		    size = (size == testsize) ? 0 : (size > testsize / 2) ? testsize : size * 2;
+
+		}
+
+		free(larr);
+	    }
+
+	    fprintf(stderr, "%d found.\n", found);
+
 	    break;
 
 	case BENCH_NONE:
@@ -312,16 +446,25 @@ int main(int argc, char **argv) {
     int testinterval = 0;
     int found = 0;
     int bench = BENCH_NONE;
-    char obuf[2001];
+    int allocmode = ALLOC_MALLOC;
+    int valuesize = 0;
+    char obuf[8001];
     char *buf = obuf;
     char *dump;
-    RbTree *tree = rbCreate();
+    RbTree *tree;
+    IrbTree *itree;
+    TestRecord *records;
+    RbFrozen *frozen;
+    BtTree *btree;
+    rb64Tree *tree64;
+    RbDict *dict;
+    char *skeys;
     uint32_t *iarr, *rarr, *sarr;
     DUR_INIT(test);
 
     memset(obuf, 0, sizeof(obuf));
 
-	while ((c = getopt(argc, argv, "?hw:H:n:r:b:smeloi:")) != -1) {
+	while ((c = getopt(argc, argv, "?hw:H:n:r:b:smeloci:a:v:")) != -1) {
 
 	    switch(c) {
 		case 'w':
@@ -369,12 +512,42 @@ int main(int argc, char **argv) {
 		case 'o':
 		    bench = BENCH_DEC_SEARCH;
 		    break;
+		case 'c':
+		    bench = BENCH_BATCH_SEARCH;
+		    break;
 		case 'i':
 		    testinterval = atoi(optarg);
 		    if(testinterval <= 0) {
 			testinterval = testsize / 100;
 		    }
 		    break;
+		case 'a':
+		    if(!strcmp(optarg, "malloc")) {
+			allocmode = ALLOC_MALLOC;
+		    } else if(!strcmp(optarg, "pool")) {
+			allocmode = ALLOC_POOL;
+		    } else if(!strcmp(optarg, "tls")) {
+			allocmode = ALLOC_POOL_TLS;
+		    } else if(!strcmp(optarg, "arena")) {
+			allocmode = ALLOC_ARENA;
+		    } else {
+			usage();
+			return -1;
+		    }
+		    break;
+		case 'v':
+		    valuesize = atoi(optarg);
+		    if(valuesize < 0) {
+			valuesize = 0;
+		    }
+#ifdef RBT_SET
+		    /* set nodes have no value to preallocate */
+		    if(valuesize > 0) {
+			fprintf(stderr, "rbt_test: -v is not supported in a RBT_SET build\n");
+			return -1;
+		    }
+#endif /* RBT_SET */
+		    break;
 		case '?':
 		case 'h':
 		default:
@@ -404,6 +577,13 @@ int main(int argc, char **argv) {
 
     fprintf(stderr, "done.\n");
 
+    tree = createTree(allocmode, valuesize);
+
+    if(tree == NULL) {
+	fprintf(stderr, "rbt_test: could not create tree\n");
+	return -1;
+    }
+
     if(bench != BENCH_NONE) {
 	runBench(tree, bench, testsize, testinterval, iarr, rarr, sarr);
 	goto cleanup;
@@ -458,6 +638,28 @@ int main(int argc, char **argv) {
     buf += sprintf(buf, "| Search, count %-10d        "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
     buf += sprintf(buf, "| Search, rate                    "   "| %-11.0f "  "| hit/s   |\n", (1000000000.0 / test_delta) * testsize);
 
+    fprintf(stderr, "Finding all %d keys in random order, in batches of %d... ", testsize, BATCHSIZE);
+    fflush(stderr);
+
+    {
+	RbNode *out[BATCHSIZE];
+
+	found = 0;
+	DUR_START(test);
+	for(i = 0; i < testsize; i += BATCHSIZE) {
+	    found += rbSearchBatch(tree, sarr + i, (testsize - i < BATCHSIZE) ? testsize - i : BATCHSIZE, out);
+	}
+	DUR_END(test);
+    }
+    fprintf(stderr, "%d found.\n", found);
+    buf += sprintf(buf, "| Batch search, count %-10d  "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+    buf += sprintf(buf, "| Batch search, rate              "   "| %-11.0f "  "| hit/s   |\n", (1000000000.0 / test_delta) * testsize);
+
+    if(found != testsize) {
+	fprintf(stderr, "Call me stupid, but this search is broken. Batch search implementation FAIL.\n");
+	return -1;
+    }
+
     fprintf(stderr, "Finding all %d keys in sequential order... ", testsize);
     fflush(stderr);
 
@@ -477,88 +679,1270 @@ int main(int argc, char **argv) {
     buf += sprintf(buf, "| Seq search, count %-10d    "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
     buf += sprintf(buf, "| Seq search, rate                "   "| %-11.0f "  "| hit/s   |\n", (1000000000.0 / test_delta) * testsize);
 
-    fprintf(stderr, "Performing in-order traversal with height and black height tracking... ");
+    fprintf(stderr, "Finding all %d keys in sequential order from the last key found... ", testsize);
     fflush(stderr);
 
-    DUR_START(test);
-    rbInOrderTrack(tree, rbDummyCallback, NULL, RB_ASC);
-    DUR_END(test);
-    fprintf(stderr, "done.\n");
-    buf += sprintf(buf, "| In-order, with tracking, rate   | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+    {
+	RbNode *finger = NULL;
 
-    fprintf(stderr, "Performing in-order traversal without height and black height tracking... ");
+	found = 0;
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+
+	    RbNode* n = rbSearchFrom(tree, finger, i);
+
+	    if(n != NULL && n->key == i) {
+		found++;
+		finger = n;
+	    }
+
+	}
+	DUR_END(test);
+    }
+    fprintf(stderr, "%d found.\n", found);
+    buf += sprintf(buf, "| Finger search, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+    buf += sprintf(buf, "| Finger search, rate             "   "| %-11.0f "  "| hit/s   |\n", (1000000000.0 / test_delta) * testsize);
+
+    if(found != testsize) {
+	fprintf(stderr, "Call me stupid, but this search is broken. Finger search implementation FAIL.\n");
+	return -1;
+    }
+
+    fprintf(stderr, "Finding lower bounds of %d keys in random order... ", testsize);
     fflush(stderr);
 
+    found = 0;
     DUR_START(test);
-    rbInOrder(tree, rbDummyCallback, NULL, RB_ASC);
+    for(i = 0; i < testsize; i++) {
+
+	RbNode* n = rbLowerBound(tree, sarr[i]);
+
+	if(n != NULL && n->key == sarr[i]) {
+	    found++;
+	}
+
+    }
     DUR_END(test);
-    fprintf(stderr, "done.\n");
-    buf += sprintf(buf, "| In-order, fast, rate            | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+    fprintf(stderr, "%d found.\n", found);
+    buf += sprintf(buf, "| Lower bound, count %-10d   "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
 
-    fprintf(stderr, "Performing breadth-first traversal with height and black height tracking... ");
+    if(found != testsize || rbUpperBound(tree, testsize - 1) != NULL || rbFloor(tree, 0) == NULL
+	    || rbNearest(tree, testsize + 1)->key != testsize - 1) {
+	fprintf(stderr, "Call me stupid, but this search is broken. Bound search implementation FAIL.\n");
+	return -1;
+    }
+
+    fprintf(stderr, "Looking up %d keys, %d%% of them from %d hot keys, without and with hot key cache... ", testsize, HOTSHARE, HOTSIZE);
     fflush(stderr);
 
-    DUR_START(test);
-    rbBreadthFirstTrack(tree, rbDummyCallback, NULL, RB_ASC);
-    DUR_END(test);
-    fprintf(stderr, "done.\n");
-    buf += sprintf(buf, "| Breadth first, tracking, rate   | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+    {
+	uint32_t *larr = malloc(testsize * sizeof(uint32_t));
+	int foundcached = 0;
 
-    fprintf(stderr, "Performing breadth-first traversal without height and black height tracking... ");
+	for(i = 0; i < testsize; i++) {
+	    larr[i] = (rand() % 100 < HOTSHARE) ? rarr[rand() % ((testsize < HOTSIZE) ? testsize : HOTSIZE)] : sarr[i];
+	}
+
+	found = 0;
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+	    found += (rbSearch(tree->root, larr[i]) != NULL);
+	}
+	DUR_END(test);
+	buf += sprintf(buf, "| Skewed search, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+	rbCacheEnable(tree, CACHESIZE);
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+	    foundcached += (rbLookup(tree, larr[i]) != NULL);
+	}
+	DUR_END(test);
+	fprintf(stderr, "%d found.\n", found);
+	buf += sprintf(buf, "| Cached lookup, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+	buf += sprintf(buf, "| Cache hit ratio, slots %-8d "   "| %-11.2f "  "| %%       |\n", CACHESIZE,
+			100.0 * tree->cache->hits / (tree->cache->hits + tree->cache->misses));
+
+	free(larr);
+
+	if(found != testsize || foundcached != testsize) {
+	    fprintf(stderr, "Call me stupid, but this cache is broken. Hot key cache implementation FAIL.\n");
+	    return -1;
+	}
+    }
+
+    rbCacheDisable(tree);
+
+    fprintf(stderr, "Building a tree with a hash index and looking up %d keys with and without it... ", testsize);
     fflush(stderr);
 
-    DUR_START(test);
-    rbBreadthFirst(tree, rbDummyCallback, NULL, RB_ASC);
-    DUR_END(test);
-    fprintf(stderr, "done.\n");
-    buf += sprintf(buf, "| Breadth first, fast, rate       | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+    {
+	RbTree *htree = rbCreateExt(RB_HASH | RB_POOL, 0, NULL);
+	int foundhashed = 0;
+	size_t hashsize;
 
-    fprintf(stderr, "Destroying tree... ");
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+	    rbInsert(htree, iarr[i]);
+	}
+	DUR_END(test);
+	buf += sprintf(buf, "| Hashed insert, rate             | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+	found = 0;
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+	    found += (rbSearch(htree->root, sarr[i]) != NULL);
+	}
+	DUR_END(test);
+	buf += sprintf(buf, "| Hashed search, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+	    foundhashed += (rbLookup(htree, sarr[i]) != NULL);
+	}
+	DUR_END(test);
+	fprintf(stderr, "%d found.\n", foundhashed);
+	buf += sprintf(buf, "| Hashed lookup, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+	/* what the lookup gain costs: index size against the nodes themselves */
+	hashsize = ((size_t)htree->hash->mask + 1) * sizeof(RbHashSlot);
+	buf += sprintf(buf, "| Hash index memory               "   "| %-11.2f "  "| B/key   |\n", (double)hashsize / testsize);
+	buf += sprintf(buf, "| Hash index, of node memory      "   "| %-11.2f "  "| %%       |\n", 100.0 * hashsize / ((size_t)testsize * htree->nodesize));
+
+	if(found != testsize || foundhashed != testsize || rbLookup(htree, testsize) != NULL
+		|| rbInOrderRange(htree, NULL, NULL, RB_ASC, 0, RB_INF, 0, RB_INF) != testsize) {
+	    fprintf(stderr, "Call me stupid, but this index is broken. Hash index implementation FAIL.\n");
+	    return -1;
+	}
+
+	rbFree(htree);
+    }
+
+    fprintf(stderr, "Looking up %d absent and %d present keys in a tree of even keys, without and with filters... ", testsize, testsize);
     fflush(stderr);
-    DUR_START(test);
-    rbFree(tree);
-    DUR_END(test);
-    fprintf(stderr, "done.\n");
-    buf += sprintf(buf, "| Destruction, rate               | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
 
-    tree = rbCreate();
+    {
+	RbTree *ftree = rbCreatePool(0);
+	RbFrozen *ffrozen;
+	RbFilterStats stats;
+	int foundfiltered = 0;
+	int falsepositives = 0;
 
-    fprintf(stderr, "Re-adding %d keys in random order... ", testsize);
+	/* absent keys have to fall between present ones, or their searches all take the same path down the edge */
+	for(i = 0; i < testsize; i++) {
+	    rbInsert(ftree, 2 * iarr[i]);
+	}
+
+	found = 0;
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+	    found += (rbSearch(ftree->root, 2 * sarr[i] + 1) != NULL);
+	}
+	DUR_END(test);
+	buf += sprintf(buf, "| Miss search, count %-10d   "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+	rbFilterEnable(ftree, 0);
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+	    found += (rbLookup(ftree, 2 * sarr[i] + 1) != NULL);
+	}
+	DUR_END(test);
+	buf += sprintf(buf, "| Filtered miss, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+	/* hits pay for the filter on top of the search */
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+	    foundfiltered += (rbLookup(ftree, 2 * sarr[i]) != NULL);
+	}
+	DUR_END(test);
+	buf += sprintf(buf, "| Filtered hit, count %-10d  "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+	rbFilterStats(ftree, &stats);
+	buf += sprintf(buf, "| Filter FPR, expected            "   "| %-11.4f "  "| %%       |\n", 100.0 * stats.fpr);
+	buf += sprintf(buf, "| Filter FPR, measured            "   "| %-11.4f "  "| %%       |\n", 100.0 * stats.measuredfpr);
+	buf += sprintf(buf, "| Filter memory                   "   "| %-11.2f "  "| bit/key |\n", stats.bitsperkey);
+
+	if(found != 0 || foundfiltered != testsize || stats.negatives + stats.falsepositives != testsize) {
+	    fprintf(stderr, "Call me stupid, but this filter is broken. Negative lookup filter implementation FAIL.\n");
+	    return -1;
+	}
+
+	/* the same on a snapshot, without a filter and then with the xor filter rbFreeze() builds for a filtered tree */
+	rbFilterDisable(ftree);
+	ffrozen = rbFreeze(ftree);
+
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+	    found += (rbfSearch(ffrozen, 2 * sarr[i] + 1) != RBF_NONE);
+	}
+	DUR_END(test);
+	buf += sprintf(buf, "| Frozen miss, count %-10d   "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+	rbfFilterEnable(ffrozen);
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+	    found += (rbfSearch(ffrozen, 2 * sarr[i] + 1) != RBF_NONE);
+	}
+	DUR_END(test);
+	fprintf(stderr, "%d found.\n", foundfiltered);
+
+	for(i = 0; i < testsize; i++) {
+	    falsepositives += kfXorQuery(ffrozen->filter, 2 * sarr[i] + 1);
+	}
+
+	buf += sprintf(buf, "| Xor miss, count %-10d      "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+	buf += sprintf(buf, "| Xor filter FPR, measured        "   "| %-11.4f "  "| %%       |\n", 100.0 * falsepositives / testsize);
+	buf += sprintf(buf, "| Xor filter memory               "   "| %-11.2f "  "| bit/key |\n", 8.0 * kfXorSize(ffrozen->filter) / testsize);
+
+	rbfFree(ffrozen);
+	rbFree(ftree);
+
+	if(found != 0) {
+	    fprintf(stderr, "Call me stupid, but this filter is broken. Xor filter implementation FAIL.\n");
+	    return -1;
+	}
+    }
+
+#ifdef RBT_ORDSTAT
+    fprintf(stderr, "Ranking %d keys and selecting %d nodes by rank in random order... ", testsize, testsize);
     fflush(stderr);
+
+    found = 0;
+    DUR_START(test);
     for(i = 0; i < testsize; i++) {
-	rbInsert(tree, iarr[i]);
+	found += (rbRank(tree, sarr[i]) == sarr[i]);
     }
-    fprintf(stderr, "done.\n");
+    DUR_END(test);
+    buf += sprintf(buf, "| Rank, count %-10d          "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
 
-    fprintf(stderr, "Removing all %d keys in sequential order... ", testsize);
-    fflush(stderr);
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+
+	RbNode* n = rbSelect(tree, sarr[i]);
+
+	if(n != NULL && n->key == sarr[i]) {
+	    found++;
+	}
+
+    }
+    DUR_END(test);
+    buf += sprintf(buf, "| Select, count %-10d        "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
 
     DUR_START(test);
     for(i = 0; i < testsize; i++) {
-	rbDeleteKey(tree, i);
+	found += (rbCountRange(tree, sarr[i] / 2, RB_INCL, sarr[i], RB_EXCL) == sarr[i] - sarr[i] / 2);
+    }
+    DUR_END(test);
+    fprintf(stderr, "%d found.\n", found / 3);
+    buf += sprintf(buf, "| Range count, count %-10d   "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+    if(found != 3 * testsize) {
+	fprintf(stderr, "Call me stupid, but these statistics are broken. Order statistics implementation FAIL.\n");
+	return -1;
     }
+#endif /* RBT_ORDSTAT */
+
+    fprintf(stderr, "Freezing tree... ");
+    fflush(stderr);
+
+    DUR_START(test);
+    frozen = rbFreeze(tree);
     DUR_END(test);
     fprintf(stderr, "done.\n");
-    buf += sprintf(buf, "| Seq removal, count %-10d   "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
-    buf += sprintf(buf, "| Seq removal, rate               | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+    buf += sprintf(buf, "| Freeze, rate                    | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
 
-    fprintf(stderr, "Re-adding %d keys in sequential order... ", testsize);
+    fprintf(stderr, "Finding all %d keys in random order in frozen tree... ", testsize);
     fflush(stderr);
+
+    found = 0;
     DUR_START(test);
     for(i = 0; i < testsize; i++) {
-	rbInsert(tree, i);
+
+	uint32_t pos = rbfSearch(frozen, sarr[i]);
+
+	if(pos != RBF_NONE && rbfKey(frozen, pos) == sarr[i]) {
+	    found++;
+	}
+
     }
     DUR_END(test);
-    fprintf(stderr, "done.\n");
-    buf += sprintf(buf, "| Seq insertion, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
-    buf += sprintf(buf, "| Seq insertion, rate             | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+    fprintf(stderr, "%d found.\n", found);
+    buf += sprintf(buf, "| Frozen search, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+    buf += sprintf(buf, "| Frozen search, rate             "   "| %-11.0f "  "| hit/s   |\n", (1000000000.0 / test_delta) * testsize);
 
-    fprintf(stderr, "Removing all %d keys in sequential order again... ", testsize);
+    if(found != testsize) {
+	fprintf(stderr, "Call me stupid, but this snapshot is broken. Frozen tree search implementation FAIL.\n");
+	return -1;
+    }
+
+    fprintf(stderr, "Scanning all %d keys in frozen tree... ", testsize);
     fflush(stderr);
-    for(i = 0; i < testsize; i++) {
-	rbDeleteKey(tree, i);
+
+    DUR_START(test);
+    found = rbfRange(frozen, NULL, NULL, 0, RB_INF, 0, RB_INF);
+    DUR_END(test);
+    fprintf(stderr, "%d found.\n", found);
+    buf += sprintf(buf, "| Frozen scan, rate               | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+    if(found != testsize || rbfRange(frozen, NULL, NULL, 1, RB_EXCL, testsize - 1, RB_EXCL) != ((testsize > 2) ? testsize - 3 : 0)) {
+	fprintf(stderr, "Call me stupid, but this snapshot is broken. Frozen tree range scan implementation FAIL.\n");
+	return -1;
+    }
+
+    rbfFree(frozen);
+
+    fprintf(stderr, "Performing in-order traversal with height and black height tracking... ");
+    fflush(stderr);
+
+    DUR_START(test);
+    rbInOrderTrack(tree, rbDummyCallback, NULL, RB_ASC);
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| In-order, with tracking, rate   | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+    fprintf(stderr, "Performing in-order traversal without height and black height tracking... ");
+    fflush(stderr);
+
+    DUR_START(test);
+    rbInOrder(tree, rbDummyCallback, NULL, RB_ASC);
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| In-order, fast, rate            | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+    fprintf(stderr, "Performing in-order traversal without allocation... ");
+    fflush(stderr);
+
+    DUR_START(test);
+    rbIterate(tree, rbDummyCallback, NULL, RB_ASC);
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| In-order, no alloc, rate        | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+    fprintf(stderr, "Performing %d short range scans of %d nodes, with and without allocation... ", testsize, SCANSIZE);
+    fflush(stderr);
+
+    found = 0;
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	found += rbInOrderRange(tree, rbDummyCallback, NULL, RB_ASC, sarr[i], RB_INCL, sarr[i] + SCANSIZE, RB_EXCL);
+    }
+    DUR_END(test);
+    buf += sprintf(buf, "| Short scan, alloc, count %-6d "   "| %-11llu "  "| ns/scan |\n", SCANSIZE, test_delta / testsize);
+
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	found -= rbIterateRange(tree, rbDummyCallback, NULL, RB_ASC, sarr[i], RB_INCL, sarr[i] + SCANSIZE, RB_EXCL);
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Short scan, no alloc, count %-4d"   "| %-11llu "  "| ns/scan |\n", SCANSIZE, test_delta / testsize);
+
+    if(found != 0 || rbNext(rbLast(tree)) != NULL || rbPrev(rbFirst(tree)) != NULL
+	    || rbIterateRange(tree, NULL, NULL, RB_DESC, 1, RB_EXCL, testsize - 1, RB_EXCL) != ((testsize > 2) ? testsize - 3 : 0)) {
+	fprintf(stderr, "Call me stupid, but this traversal is broken. Allocation-free traversal implementation FAIL.\n");
+	return -1;
+    }
+
+    fprintf(stderr, "Performing breadth-first traversal with height and black height tracking... ");
+    fflush(stderr);
+
+    DUR_START(test);
+    rbBreadthFirstTrack(tree, rbDummyCallback, NULL, RB_ASC);
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Breadth first, tracking, rate   | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+    fprintf(stderr, "Performing breadth-first traversal without height and black height tracking... ");
+    fflush(stderr);
+
+    DUR_START(test);
+    rbBreadthFirst(tree, rbDummyCallback, NULL, RB_ASC);
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Breadth first, fast, rate       | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+    fprintf(stderr, "Destroying tree... ");
+    fflush(stderr);
+    DUR_START(test);
+    rbFree(tree);
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Destruction, rate               | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+    fprintf(stderr, "Building a tree from %d sorted keys in one go... ", testsize);
+    fflush(stderr);
+
+    {
+	uint32_t *karr = malloc(testsize * sizeof(uint32_t));
+	RbTree *btree;
+
+	for(i = 0; i < testsize; i++) {
+	    karr[i] = i;
+	}
+
+	DUR_START(test);
+	btree = rbBuildSorted(karr, NULL, testsize);
+	DUR_END(test);
+	fprintf(stderr, "done.\n");
+	buf += sprintf(buf, "| Bulk build, count %-10d    "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+	buf += sprintf(buf, "| Bulk build, rate                | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+	fprintf(stderr, "Verifying bulk built tree... ");
+	if(btree == NULL || !rbVerify(btree, RB_CHATTY, RB_FULL) || btree->count != testsize) {
+	    fprintf(stderr, "Call me stupid, but this tree is broken. Bulk build implementation FAIL.\n");
+	    return -1;
+	}
+
+	found = 0;
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+	    found += (rbSearch(btree->root, sarr[i]) != NULL);
+	}
+	DUR_END(test);
+	buf += sprintf(buf, "| Bulk search, count %-10d   "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+	if(found != testsize) {
+	    fprintf(stderr, "Call me stupid, but this tree is broken. Bulk build implementation FAIL.\n");
+	    return -1;
+	}
+
+	rbFree(btree);
+	free(karr);
+    }
+
+    fprintf(stderr, "Inserting %d random keys in one batch, then %d more in %d batches, then deleting them in one batch... ",
+		testsize, testsize / 2, BATCHUPDATES);
+    fflush(stderr);
+
+    {
+	RbTree *btree = rbCreatePool(0);
+	uint32_t *barr = malloc(testsize * sizeof(uint32_t));
+	uint32_t inserted = 0, deleted;
+	int batchsize = (testsize / 2 + BATCHUPDATES - 1) / BATCHUPDATES;
+
+	for(i = 0; i < testsize; i++) {
+	    barr[i] = 2 * iarr[i];
+	}
+
+	/* an empty tree takes the whole batch in one merge */
+	DUR_START(test);
+	inserted += rbInsertBatch(btree, barr, testsize);
+	DUR_END(test);
+	buf += sprintf(buf, "| Batch insert, count %-10d  "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+	/* small batches relative to the tree go in one by one, each key starting from the previous one */
+	for(i = 0; i < testsize / 2; i++) {
+	    barr[i] = 2 * sarr[i] + 1;
+	}
+	DUR_START(test);
+	for(i = 0; i < testsize / 2; i += batchsize) {
+	    inserted += rbInsertBatch(btree, barr + i, (testsize / 2 - i < batchsize) ? testsize / 2 - i : batchsize);
+	}
+	DUR_END(test);
+	buf += sprintf(buf, "| Batch insert, %-4d batches      "   "| %-11llu "  "| ns/key  |\n", BATCHUPDATES, test_delta / (testsize / 2 + 1));
+
+	DUR_START(test);
+	deleted = rbDeleteBatch(btree, barr, testsize / 2);
+	DUR_END(test);
+	fprintf(stderr, "%d inserted, %d deleted.\n", inserted, deleted);
+	buf += sprintf(buf, "| Batch delete, count %-10d  "   "| %-11llu "  "| ns/key  |\n", testsize / 2, test_delta / (testsize / 2 + 1));
+
+	if(inserted != testsize + testsize / 2 || deleted != testsize / 2 || btree->count != testsize
+		|| !rbVerify(btree, RB_QUIET, RB_FULL) || rbSearch(btree->root, 2 * iarr[testsize / 2]) == NULL) {
+	    fprintf(stderr, "Call me stupid, but this tree is broken. Batch update implementation FAIL.\n");
+	    return -1;
+	}
+
+	rbFree(btree);
+	free(barr);
+    }
+
+    fprintf(stderr, "Deleting the middle half of a %d key tree key by key vs. splitting it off... ", testsize);
+    fflush(stderr);
+
+    {
+	RbTree *dtree = rbCreatePool(0);
+	uint32_t low = testsize / 4, high = testsize - testsize / 4, deleted = 0;
+
+	for(i = 0; i < testsize; i++) {
+	    rbInsert(dtree, iarr[i]);
+	}
+
+	/* the old way: one search and one rebalance per key */
+	DUR_START(test);
+	for(i = low; i < high; i++) {
+	    rbDeleteKey(dtree, i);
+	}
+	DUR_END(test);
+	buf += sprintf(buf, "| Range delete, by key %-10d "   "| %-11llu "  "| ns/key  |\n", high - low, test_delta / (high - low + 1));
+
+	for(i = 0; i < testsize; i++) {
+	    rbInsert(dtree, iarr[i]);
+	}
+
+	DUR_START(test);
+	deleted = rbDeleteRange(dtree, low, RB_INCL, high, RB_EXCL, NULL);
+	DUR_END(test);
+	fprintf(stderr, "%d deleted.\n", deleted);
+	buf += sprintf(buf, "| Range delete, split %-10d  "   "| %-11llu "  "| ns/key  |\n", high - low, test_delta / (high - low + 1));
+
+	if(deleted != high - low || dtree->count != testsize - deleted || !rbVerify(dtree, RB_QUIET, RB_FULL)
+		|| (testsize > 1 && rbSearch(dtree->root, testsize - 1) == NULL) || (low < high && rbSearch(dtree->root, low) != NULL)) {
+	    fprintf(stderr, "Call me stupid, but this tree is broken. Range deletion implementation FAIL.\n");
+	    return -1;
+	}
+
+	rbFree(dtree);
+    }
+
+    fprintf(stderr, "Splitting a %d key tree at %d random keys, joining the parts back every time... ", testsize, SPLITS);
+    fflush(stderr);
+
+    {
+	RbTree *stree = rbCreatePool(0);
+	RbTree *lo, *hi;
+	unsigned long long split_delta = 0, join_delta = 0;
+	int joined = 0;
+
+	for(i = 0; i < testsize; i++) {
+	    rbInsert(stree, iarr[i]);
+	}
+
+	for(i = 0; i < SPLITS; i++) {
+
+	    DUR_START(test);
+	    rbSplit(stree, sarr[i % testsize], &lo, &hi);
+	    DUR_END(test);
+	    split_delta += test_delta;
+
+	    DUR_START(test);
+	    joined += (rbConcat(lo, hi) == stree);
+	    DUR_END(test);
+	    join_delta += test_delta;
+
+	    rbFree(hi);
+
+	}
+
+	fprintf(stderr, "%d joined.\n", joined);
+	buf += sprintf(buf, "| Split, tree size %-10d     "   "| %-11llu "  "| ns/op   |\n", testsize, split_delta / SPLITS);
+	buf += sprintf(buf, "| Concat, tree size %-10d    "   "| %-11llu "  "| ns/op   |\n", testsize, join_delta / SPLITS);
+
+	if(joined != SPLITS || rbCount(stree) != testsize || !rbVerify(stree, RB_QUIET, RB_FULL)) {
+	    fprintf(stderr, "Call me stupid, but this tree is broken. Split / join implementation FAIL.\n");
+	    return -1;
+	}
+
+	rbFree(stree);
+    }
+
+    fprintf(stderr, "Splitting and joining %d key trees with a hash index, a filter and cache, and intrusive... ", testsize);
+    fflush(stderr);
+
+    {
+	RbTree *itree, *lo, *hi, *in, *out;
+	RbNode *nodes = calloc(testsize, sizeof(RbNode));
+	RbNode *n;
+	uint32_t key;
+	int variant, j, broken = 0;
+
+	for(variant = 0; variant < 3; variant++) {
+
+	    if(variant == 0) {
+		itree = rbCreateExt(RB_HASH | RB_POOL, 0, NULL);
+	    } else if(variant == 1) {
+		itree = rbCreatePool(0);
+		rbFilterEnable(itree, 0);
+		rbCacheEnable(itree, CACHESIZE);
+	    } else {
+		itree = rbCreateIntrusive();
+	    }
+
+	    for(i = 0; i < testsize; i++) {
+		if(variant == 2) {
+		    nodes[i].key = iarr[i];
+		    rbInsertNode(itree, &nodes[i]);
+		} else {
+		    rbInsert(itree, iarr[i]);
+		}
+	    }
+
+	    for(j = 0; j < 4; j++) {
+
+		key = sarr[j % testsize];
+
+		/* some of the keys about to move are in the cache */
+		for(i = 0; i < testsize; i += 7) {
+		    rbLookup(itree, i);
+		}
+
+		rbSplit(itree, key, &lo, &hi);
+
+		for(i = 0; i < testsize; i++) {
+		    in = ((uint32_t)i < key) ? lo : hi;
+		    out = ((uint32_t)i < key) ? hi : lo;
+		    n = rbLookup(in, i);
+		    if(n == NULL || n->key != (uint32_t)i || rbLookup(out, i) != NULL) {
+			broken++;
+		    }
+		}
+
+		if(rbCount(lo) + rbCount(hi) != testsize || !rbVerify(lo, RB_QUIET, RB_FULL) || !rbVerify(hi, RB_QUIET, RB_FULL)) {
+		    broken++;
+		}
+
+		/* back together: intrusive trees by union, others by concat, or by a join around the split key taken out */
+		if(variant == 2) {
+		    broken += (rbUnion(lo, hi) != lo);
+		} else if((j & 1) && rbLookup(hi, key) != NULL) {
+		    rbDeleteKey(hi, key);
+		    broken += (rbJoin(lo, key, hi) != lo);
+		} else {
+		    broken += (rbConcat(lo, hi) != lo);
+		}
+
+		rbFree(hi);
+
+		for(i = 0; i < testsize; i++) {
+		    n = rbLookup(itree, i);
+		    if(n == NULL || n->key != (uint32_t)i) {
+			broken++;
+		    }
+		}
+
+		if(rbCount(itree) != testsize || !rbVerify(itree, RB_QUIET, RB_FULL)) {
+		    broken++;
+		}
+
+	    }
+
+	    rbFree(itree);
+
+	}
+
+	free(nodes);
+
+	fprintf(stderr, "done.\n");
+
+	if(broken > 0) {
+	    fprintf(stderr, "Call me stupid, but this tree is broken. Indexed split / join implementation FAIL.\n");
+	    return -1;
+	}
+    }
+
+    fprintf(stderr, "Set algebra on two %d key trees overlapping by half, times per key of one tree... ", testsize);
+    fflush(stderr);
+
+    {
+	RbTree *atree = rbCreatePool(0), *btree = rbCreatePool(0), *ctree;
+	RbNode *n;
+	const uint32_t shift = testsize / 2;
+	unsigned long long lookup_delta;
+	int op, good = 0;
+
+	for(i = 0; i < testsize; i++) {
+	    rbInsert(atree, iarr[i]);
+	    rbInsert(btree, iarr[i] + shift);
+	}
+
+	/* the old way: look up every key of one tree in the other */
+	ctree = rbCreatePool(0);
+	DUR_START(test);
+	for(n = rbFirst(btree); n != NULL; n = rbNext(n)) {
+	    if(rbSearch(atree->root, n->key) != NULL) {
+		rbInsert(ctree, n->key);
+	    }
+	}
+	DUR_END(test);
+	lookup_delta = test_delta;
+	good += (ctree->count == testsize - shift);
+	rbFree(ctree);
+
+	DUR_START(test);
+	ctree = rbUnionCopy(atree, btree);
+	DUR_END(test);
+	/* the copy has a pool of its own, so a's stays private */
+	good += (ctree != NULL && ctree->count == testsize + shift && atree->count == testsize && atree->pool->users == 1);
+	rbFree(ctree);
+	buf += sprintf(buf, "| Union, copies                   "   "| %-11llu "  "| ns/key  |\n", test_delta / testsize);
+
+	for(op = 0; op < 3; op++) {
+
+	    if(op > 0) {
+		rbFree(atree);
+		rbFree(btree);
+		atree = rbCreatePool(0);
+		btree = rbCreatePool(0);
+		for(i = 0; i < testsize; i++) {
+		    rbInsert(atree, iarr[i]);
+		    rbInsert(btree, iarr[i] + shift);
+		}
+	    }
+
+	    DUR_START(test);
+	    if(op == 0) {
+		good += (rbUnion(atree, btree) == atree && atree->count == testsize + shift);
+	    } else if(op == 1) {
+		good += (rbIntersect(atree, btree) == atree && atree->count == testsize - shift);
+	    } else {
+		good += (rbDifference(atree, btree) == atree && atree->count == shift);
+	    }
+	    DUR_END(test);
+
+	    good += (btree->count == 0 && rbVerify(atree, RB_QUIET, RB_FULL));
+
+	    if(op == 0) {
+		buf += sprintf(buf, "| Union, in place                 "   "| %-11llu "  "| ns/key  |\n", test_delta / testsize);
+	    } else if(op == 1) {
+		buf += sprintf(buf, "| Intersection, by lookup         "   "| %-11llu "  "| ns/key  |\n", lookup_delta / testsize);
+		buf += sprintf(buf, "| Intersection, in place          "   "| %-11llu "  "| ns/key  |\n", test_delta / testsize);
+	    } else {
+		buf += sprintf(buf, "| Difference, in place            "   "| %-11llu "  "| ns/key  |\n", test_delta / testsize);
+	    }
+
+	}
+
+	fprintf(stderr, "done.\n");
+
+	rbFree(atree);
+	rbFree(btree);
+
+	if(good != 8) {
+	    fprintf(stderr, "Call me stupid, but this tree is broken. Set algebra implementation FAIL.\n");
+	    return -1;
+	}
+    }
+
+    fprintf(stderr, "Set algebra on trees with a hash index, a filter and cache, on one thread vs. %d... ", SETTHREADS);
+    fflush(stderr);
+
+    {
+	RbTree *atree, *btree;
+	uint32_t key, counts[2];
+	bool want;
+	int variant, op, run, broken = 0;
+
+	for(variant = 0; variant < 2; variant++) {
+	    for(op = 0; op < 3; op++) {
+		for(run = 0; run < 2; run++) {
+
+		    /* big enough to fork */
+		    rbSetThreads((run == 0) ? 1 : SETTHREADS);
+
+		    if(variant == 0) {
+			atree = rbCreateExt(RB_HASH | RB_POOL, 0, NULL);
+			btree = rbCreateExt(RB_HASH | RB_POOL, 0, NULL);
+		    } else {
+			atree = rbCreatePool(0);
+			btree = rbCreatePool(0);
+		    }
+
+		    /* a holds the lower two thirds of the keys, b the upper two thirds */
+		    for(key = 0; key < 2 * SETCHECKSIZE; key++) {
+			rbInsert(atree, key);
+			rbInsert(btree, key + SETCHECKSIZE);
+		    }
+
+		    /* a filter sized for a's keys has room for b's, so a union adds them up front rather than rebuilding */
+		    if(variant == 1) {
+			rbFilterEnable(atree, 0);
+			rbCacheEnable(atree, CACHESIZE);
+		    }
+
+		    for(key = 0; key < 3 * SETCHECKSIZE; key += 5) {
+			rbLookup(atree, key);
+		    }
+
+		    if(op == 0) {
+			broken += (rbUnion(atree, btree) != atree);
+		    } else if(op == 1) {
+			broken += (rbIntersect(atree, btree) != atree);
+		    } else {
+			broken += (rbDifference(atree, btree) != atree);
+		    }
+
+		    for(key = 0; key < 3 * SETCHECKSIZE; key++) {
+			if(op == 0) {
+			    want = true;
+			} else if(op == 1) {
+			    want = key >= SETCHECKSIZE && key < 2 * SETCHECKSIZE;
+			} else {
+			    want = key < SETCHECKSIZE;
+			}
+			if(rbLookup(atree, key) != rbSearch(atree->root, key) || (rbSearch(atree->root, key) != NULL) != want) {
+			    broken++;
+			}
+		    }
+
+		    counts[run] = rbCount(atree);
+		    broken += !rbVerify(atree, RB_QUIET, RB_FULL);
+
+		    rbFree(atree);
+		    rbFree(btree);
+
+		}
+
+		broken += (counts[0] != counts[1]);
+
+	    }
+	}
+
+	rbSetThreads(0);
+
+	fprintf(stderr, "done.\n");
+
+	if(broken > 0) {
+	    fprintf(stderr, "Call me stupid, but this tree is broken. Indexed / parallel set algebra implementation FAIL.\n");
+	    return -1;
+	}
+    }
+
+    fprintf(stderr, "Draining a %d key tree from the lowest key, walking down and deleting vs. popping... ", testsize);
+    fflush(stderr);
+
+    {
+	RbTree *qtree = rbCreatePool(0);
+	RbNode *n;
+	uint32_t last = 0;
+	int ordered = 0;
+
+	for(i = 0; i < testsize; i++) {
+	    rbInsert(qtree, iarr[i]);
+	}
+
+	/* the old way: walk left from the root, then delete */
+	DUR_START(test);
+	while(qtree->root != NULL) {
+	    for(n = qtree->root; n->children[RB_LEFT] != NULL; n = n->children[RB_LEFT]);
+	    rbDeleteNode(qtree, n);
+	}
+	DUR_END(test);
+	buf += sprintf(buf, "| Drain, walk and delete, rate    | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+	for(i = 0; i < testsize; i++) {
+	    rbInsert(qtree, iarr[i]);
+	}
+
+	DUR_START(test);
+	while((n = rbPopMin(qtree)) != NULL) {
+	    ordered += (n->key >= last);
+	    last = n->key;
+	    rbFreeNode(qtree, n);
+	}
+	DUR_END(test);
+	fprintf(stderr, "done.\n");
+	buf += sprintf(buf, "| Drain, pop min, rate            | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+	if(ordered != testsize || qtree->count != 0 || rbMin(qtree) != NULL || rbMax(qtree) != NULL) {
+	    fprintf(stderr, "Call me stupid, but this queue is broken. Pop min implementation FAIL.\n");
+	    return -1;
+	}
+
+	rbFree(qtree);
+    }
+
+    fprintf(stderr, "Inserting %d random keys into index-linked tree... ", testsize);
+    fflush(stderr);
+
+    itree = irbCreate();
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	irbInsert(itree, iarr[i]);
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Idx insertion, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+    fprintf(stderr, "Verifying index-linked red-black tree... ");
+    fflush(stderr);
+
+    if(!irbVerify(itree, RB_CHATTY, RB_FULL)) {
+	fprintf(stderr, "Call me stupid, but this tree is broken. Index-linked tree insertion implementation FAIL.\n");
+	return -1;
+    }
+
+    fprintf(stderr, "Finding all %d keys in random order in index-linked tree... ", testsize);
+    fflush(stderr);
+
+    found = 0;
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+
+	IrbNode* n = irbSearch(itree, sarr[i]);
+
+	if(n != NULL && n->key == sarr[i]) {
+	    found++;
+	}
+
+    }
+    DUR_END(test);
+    fprintf(stderr, "%d found.\n", found);
+    buf += sprintf(buf, "| Idx search, count %-10d    "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+    fprintf(stderr, "Removing %d keys in random order from index-linked tree... ", testsize - keepsize);
+    fflush(stderr);
+
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	if(rarr[i] >= keepsize) {
+	    irbDeleteKey(itree, rarr[i]);
+	}
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Idx removal, count %-10d   "   "| %-11llu "  "| ns/key  |\n", testsize - keepsize, (testsize <= keepsize) ? 0 : test_delta / (testsize - keepsize));
+
+    fprintf(stderr, "Verifying index-linked red-black tree... ");
+    fflush(stderr);
+
+    if(!irbVerify(itree, RB_CHATTY, RB_FULL)) {
+	fprintf(stderr, "Call me stupid, but this tree is broken. Index-linked tree removal implementation FAIL.\n");
+	return -1;
+    }
+
+    irbFree(itree);
+
+    fprintf(stderr, "Inserting %d random keys into intrusive tree... ", testsize);
+    fflush(stderr);
+
+    records = calloc(testsize, sizeof(TestRecord));
+    tree = rbCreateIntrusive();
+    for(i = 0; i < testsize; i++) {
+	records[i].payload = ~iarr[i];
+	records[i].node.key = iarr[i];
+    }
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	rbInsertNode(tree, &records[i].node);
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Intr. insert, count %-10d  "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+    fprintf(stderr, "Verifying intrusive red-black tree... ");
+    fflush(stderr);
+
+    if(!rbVerify(tree, RB_CHATTY, RB_FULL)) {
+	fprintf(stderr, "Call me stupid, but this tree is broken. Intrusive tree insertion implementation FAIL.\n");
+	return -1;
+    }
+
+    fprintf(stderr, "Finding all %d keys in random order in intrusive tree... ", testsize);
+    fflush(stderr);
+
+    found = 0;
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+
+	RbNode* n = rbSearch(tree->root, sarr[i]);
+
+	if(n != NULL && rbContainerOf(n, TestRecord, node)->payload == ~sarr[i]) {
+	    found++;
+	}
+
+    }
+    DUR_END(test);
+    fprintf(stderr, "%d found.\n", found);
+    buf += sprintf(buf, "| Intr. search, count %-10d  "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+    fprintf(stderr, "Removing %d keys in random order from intrusive tree... ", testsize - keepsize);
+    fflush(stderr);
+
+    /* records[] are in insertion order, iarr[i] is the key of records[i] */
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	if(iarr[i] >= keepsize) {
+	    rbRemoveNode(tree, &records[i].node);
+	}
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Intr. removal, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize - keepsize, (testsize <= keepsize) ? 0 : test_delta / (testsize - keepsize));
+
+    fprintf(stderr, "Verifying intrusive red-black tree... ");
+    fflush(stderr);
+
+    if(!rbVerify(tree, RB_CHATTY, RB_FULL) || tree->count != ((testsize < keepsize) ? testsize : keepsize)) {
+	fprintf(stderr, "Call me stupid, but this tree is broken. Intrusive tree removal implementation FAIL.\n");
+	return -1;
+    }
+
+    rbFree(tree);
+    free(records);
+
+    fprintf(stderr, "Inserting %d random keys into B-tree... ", testsize);
+    fflush(stderr);
+
+    btree = btCreate();
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	btInsert(btree, iarr[i]);
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| B-tree insert, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+    fprintf(stderr, "Verifying B-tree... ");
+    fflush(stderr);
+
+    if(!btVerify(btree, RB_CHATTY)) {
+	fprintf(stderr, "Call me stupid, but this tree is broken. B-tree insertion implementation FAIL.\n");
+	return -1;
+    }
+
+    fprintf(stderr, "Finding all %d keys in random order in B-tree... ", testsize);
+    fflush(stderr);
+
+    found = 0;
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+
+	if(btSearch(btree, sarr[i]) != NULL) {
+	    found++;
+	}
+
+    }
+    DUR_END(test);
+    fprintf(stderr, "%d found.\n", found);
+    buf += sprintf(buf, "| B-tree search, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+    buf += sprintf(buf, "| B-tree search, rate             "   "| %-11.0f "  "| hit/s   |\n", (1000000000.0 / test_delta) * testsize);
+
+    fprintf(stderr, "Performing in-order traversal of B-tree... ");
+    fflush(stderr);
+
+    DUR_START(test);
+    found = btInOrderRange(btree, btDummyCallback, NULL, RB_ASC, 0, RB_INF, 0, RB_INF);
+    DUR_END(test);
+    fprintf(stderr, "%d found.\n", found);
+    buf += sprintf(buf, "| B-tree in-order, rate           | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+    if(found != testsize) {
+	fprintf(stderr, "Call me stupid, but this tree is broken. B-tree traversal implementation FAIL.\n");
+	return -1;
+    }
+
+    fprintf(stderr, "Removing %d keys in random order from B-tree... ", testsize - keepsize);
+    fflush(stderr);
+
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	if(rarr[i] >= keepsize) {
+	    btDeleteKey(btree, rarr[i]);
+	}
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| B-tree removal, count %-10d"   "| %-11llu "  "| ns/key  |\n", testsize - keepsize, (testsize <= keepsize) ? 0 : test_delta / (testsize - keepsize));
+
+    fprintf(stderr, "Verifying B-tree... ");
+    fflush(stderr);
+
+    if(!btVerify(btree, RB_CHATTY)) {
+	fprintf(stderr, "Call me stupid, but this tree is broken. B-tree removal implementation FAIL.\n");
+	return -1;
+    }
+
+    btFree(btree);
+
+    fprintf(stderr, "Inserting %d random keys into 64-bit key tree... ", testsize);
+    fflush(stderr);
+
+    tree64 = rb64Create();
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	rb64Insert(tree64, KEY64(iarr[i]));
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| 64-bit insert, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+    fprintf(stderr, "Finding all %d keys in random order in 64-bit key tree... ", testsize);
+    fflush(stderr);
+
+    found = 0;
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+
+	rb64Node* n = rb64Search(tree64, KEY64(sarr[i]));
+
+	if(n != NULL && n->key == KEY64(sarr[i])) {
+	    found++;
+	}
+
+    }
+    DUR_END(test);
+    fprintf(stderr, "%d found.\n", found);
+    buf += sprintf(buf, "| 64-bit search, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+    fprintf(stderr, "Removing %d keys in random order from 64-bit key tree... ", testsize - keepsize);
+    fflush(stderr);
+
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	if(rarr[i] >= keepsize) {
+	    rb64DeleteKey(tree64, KEY64(rarr[i]));
+	}
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| 64-bit removal, count %-10d"   "| %-11llu "  "| ns/key  |\n", testsize - keepsize, (testsize <= keepsize) ? 0 : test_delta / (testsize - keepsize));
+
+    fprintf(stderr, "Verifying 64-bit key tree... ");
+    fflush(stderr);
+
+    if(!rb64Verify(tree64) || found != testsize) {
+	fprintf(stderr, "Call me stupid, but this tree is broken. Generic tree implementation FAIL.\n");
+	return -1;
+    }
+    fprintf(stderr, "done.\n");
+
+    rb64Free(tree64);
+
+    fprintf(stderr, "Inserting %d random string keys into dictionary... ", testsize);
+    fflush(stderr);
+
+    /* string forms of keys 0..testsize - 1 */
+    skeys = malloc(testsize * SKEYSIZE);
+    for(i = 0; i < testsize; i++) {
+	SKEY(skeys + i * SKEYSIZE, i);
+    }
+
+    dict = rbdCreate(NULL);
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	const char *key = skeys + iarr[i] * SKEYSIZE;
+	*rbdInsert(dict, key, strlen(key)) = (void*)(uintptr_t)iarr[i];
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Dict insert, count %-10d   "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+    fprintf(stderr, "Finding all %d string keys in random order in dictionary... ", testsize);
+    fflush(stderr);
+
+    found = 0;
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+
+	const char *key = skeys + sarr[i] * SKEYSIZE;
+	void **value = rbdSearch(dict, key, strlen(key));
+
+	if(value != NULL && (uintptr_t)*value == sarr[i]) {
+	    found++;
+	}
+
+    }
+    DUR_END(test);
+    fprintf(stderr, "%d found.\n", found);
+    buf += sprintf(buf, "| Dict search, count %-10d   "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+    fprintf(stderr, "Removing %d string keys in random order from dictionary... ", testsize - keepsize);
+    fflush(stderr);
+
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	if(rarr[i] >= keepsize) {
+	    const char *key = skeys + rarr[i] * SKEYSIZE;
+	    rbdDelete(dict, key, strlen(key));
+	}
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Dict removal, count %-10d  "   "| %-11llu "  "| ns/key  |\n", testsize - keepsize, (testsize <= keepsize) ? 0 : test_delta / (testsize - keepsize));
+
+    if(found != testsize || rbdCount(dict) != ((testsize < keepsize) ? testsize : keepsize)) {
+	fprintf(stderr, "Call me stupid, but this dictionary is broken. Dictionary implementation FAIL.\n");
+	return -1;
+    }
+
+    rbdFree(dict);
+    free(skeys);
+
+    tree = createTree(allocmode, valuesize);
+
+    if(tree == NULL) {
+	fprintf(stderr, "rbt_test: could not create tree\n");
+	return -1;
+    }
+
+    fprintf(stderr, "Re-adding %d keys in random order... ", testsize);
+    fflush(stderr);
+    for(i = 0; i < testsize; i++) {
+	rbInsert(tree, iarr[i]);
+    }
+    fprintf(stderr, "done.\n");
+
+    fprintf(stderr, "Removing all %d keys in sequential order... ", testsize);
+    fflush(stderr);
+
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	rbDeleteKey(tree, i);
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Seq removal, count %-10d   "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+    buf += sprintf(buf, "| Seq removal, rate               | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+    fprintf(stderr, "Re-adding %d keys in sequential order... ", testsize);
+    fflush(stderr);
+    DUR_START(test);
+    for(i = 0; i < testsize; i++) {
+	rbInsert(tree, i);
+    }
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Seq insertion, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+    buf += sprintf(buf, "| Seq insertion, rate             | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+    fprintf(stderr, "Removing all %d keys in sequential order again... ", testsize);
+    fflush(stderr);
+    for(i = 0; i < testsize; i++) {
+	rbDeleteKey(tree, i);
+    }
+    fprintf(stderr, "done.\n");
+
+    fprintf(stderr, "Re-adding %d keys in sequential order, hinted with the last node... ", testsize);
+    fflush(stderr);
+    {
+	RbNode *hint = NULL;
+
+	DUR_START(test);
+	for(i = 0; i < testsize; i++) {
+	    hint = rbInsertHint(tree, hint, i);
+	}
+	DUR_END(test);
+    }
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Hinted insert, count %-10d "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+    buf += sprintf(buf, "| Hinted insert, rate             | %-11.0f "  "| nodes/s |\n", (1000000000.0 / test_delta) * testsize );
+
+    if(tree->count != testsize || !rbVerify(tree, RB_QUIET, RB_STOP)) {
+	fprintf(stderr, "Call me stupid, but this tree is broken. Hinted insertion implementation FAIL.\n");
+	return -1;
+    }
+
+    fprintf(stderr, "Removing all %d keys in sequential order again... ", testsize);
+    fflush(stderr);
+    for(i = 0; i < testsize; i++) {
+	rbDeleteKey(tree, i);
+    }
+    fprintf(stderr, "done.\n");
+
+    fprintf(stderr, "Re-adding %d keys in random order and emptying the tree in one call... ", testsize);
+    fflush(stderr);
+    for(i = 0; i < testsize; i++) {
+	rbInsert(tree, iarr[i]);
+    }
+    DUR_START(test);
+    rbEmpty(tree);
+    DUR_END(test);
+    fprintf(stderr, "done.\n");
+    buf += sprintf(buf, "| Empty tree, count %-10d    "   "| %-11llu "  "| ns/key  |\n", testsize, test_delta / testsize);
+
+    if(tree->count != 0 || tree->root != NULL || tree->min != NULL || !rbVerify(tree, RB_QUIET, RB_FULL)) {
+	fprintf(stderr, "Call me stupid, but this tree is broken. Tree emptying implementation FAIL.\n");
+	return -1;
     }
-    fprintf(stderr, "done.\n");
 
     fprintf(stderr, "Re-adding %d keys in random order... ", testsize);
     fflush(stderr);
@@ -612,7 +1996,7 @@ int main(int argc, char **argv) {
 
 	    RbNode* n = rbSearch(tree->root, rand() % keepsize);
 	    if(n != NULL) {
-		n->red = true;
+		rbSetRed(n, true);
 	    }
 
 	}
@@ -634,6 +2018,7 @@ cleanup:
     fflush(stderr);
 
     rbFree(tree);
+    rbPoolThreadFree();
 
     free(iarr);
     free(rarr);
@@ -0,0 +1,217 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   tp.c
+ * @date   Fri Oct 16 19:45:00 2026
+ *
+ * @brief  minimal fork-join thread pool. One mutex guards the queue and the task states:
+ *         the tasks it is meant for (halves of a divide and conquer job) are few and big,
+ *         so the lock is never contended enough to call for per-thread deques.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "xalloc.h"
+#include "tp.h"
+
+/* take the first queued task, NULL if there is none. Called with the lock held */
+static inline TpTask* tpTake(TPool *pool) {
+
+    TpTask *ret = pool->head;
+
+    if(ret != NULL) {
+	pool->head = ret->next;
+	if(pool->head == NULL) {
+	    pool->tail = NULL;
+	}
+    }
+
+    return ret;
+
+}
+
+/* run a task without the lock, then mark it done. Called with the lock held */
+static inline void tpRun(TPool *pool, TpTask *task) {
+
+    pthread_mutex_unlock(&pool->lock);
+    task->run(task->arg);
+    pthread_mutex_lock(&pool->lock);
+
+    task->done = true;
+    pthread_cond_broadcast(&pool->done);
+
+}
+
+/* worker thread: run tasks until told to stop */
+static void* tpWorker(void *arg) {
+
+    TPool *pool = arg;
+    TpTask *task;
+
+    pthread_mutex_lock(&pool->lock);
+
+    for(;;) {
+
+	while(pool->head == NULL && !pool->stop) {
+	    pthread_cond_wait(&pool->work, &pool->lock);
+	}
+
+	if((task = tpTake(pool)) == NULL) {
+	    break;
+	}
+
+	tpRun(pool, task);
+
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+
+}
+
+/* create a pool */
+TPool* tpCreate(const unsigned int threads) {
+
+    TPool *ret;
+    unsigned int count = threads;
+
+    if(count == 0) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	count = (cpus > 0) ? (unsigned int)cpus : 1;
+    }
+
+    xcalloc(ret, 1, sizeof(TPool));
+    xcalloc(ret->threads, count, sizeof(pthread_t));
+
+    pthread_mutex_init(&ret->lock, NULL);
+    pthread_cond_init(&ret->work, NULL);
+    pthread_cond_init(&ret->done, NULL);
+    ret->users = 1;
+
+    /* the caller is one of the threads */
+    for(ret->count = 0; ret->count < count - 1; ret->count++) {
+	if(pthread_create(&ret->threads[ret->count], NULL, tpWorker, ret) != 0) {
+	    break;
+	}
+    }
+
+    return ret;
+
+}
+
+/* add a user to the pool */
+TPool* tpShare(TPool *pool) {
+
+    pthread_mutex_lock(&pool->lock);
+    pool->users++;
+    pthread_mutex_unlock(&pool->lock);
+
+    return pool;
+
+}
+
+/* let go of the pool, stop and free it once unused */
+void tpFree(TPool *pool) {
+
+    unsigned int i;
+
+    if(pool != NULL) {
+
+	pthread_mutex_lock(&pool->lock);
+	if(--pool->users > 0) {
+	    pthread_mutex_unlock(&pool->lock);
+	    return;
+	}
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(i = 0; i < pool->count; i++) {
+	    pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->done);
+	free(pool->threads);
+	free(pool);
+
+    }
+
+}
+
+/* queue a task */
+void tpSubmit(TPool *pool, TpTask *task, void (*run) (void *arg), void *arg) {
+
+    task->run = run;
+    task->arg = arg;
+    task->next = NULL;
+    task->done = false;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if(pool->tail == NULL) {
+	pool->head = task;
+    } else {
+	pool->tail->next = task;
+    }
+    pool->tail = task;
+
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+}
+
+/* wait for a task, helping out with the queue */
+void tpWait(TPool *pool, TpTask *task) {
+
+    TpTask *other;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while(!task->done) {
+	/* often the task itself is still queued, and this is where it runs */
+	if((other = tpTake(pool)) != NULL) {
+	    tpRun(pool, other);
+	} else {
+	    pthread_cond_wait(&pool->done, &pool->lock);
+	}
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+}
@@ -0,0 +1,81 @@
+/* BSD 2-Clause License
+ *
+ * Copyright (c) 2018, Wojciech Owczarek
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file   tp.h
+ * @date   Fri Oct 16 19:45:00 2026
+ *
+ * @brief  minimal fork-join thread pool: tasks go on one shared queue, and a thread
+ *         waiting for a task runs queued tasks in the meantime, so that tasks can fork
+ *         and wait for other tasks without tying up the pool
+ *
+ */
+
+#ifndef TP_H_
+#define TP_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct TpTask TpTask;
+
+/* a task, owned by whoever submits it (usually on its stack) until tpWait() returns */
+struct TpTask {
+    void (*run) (void *arg);
+    void *arg;
+    TpTask *next;
+    bool done; /* protected by the pool lock */
+};
+
+/* pool structure */
+typedef struct {
+    pthread_t *threads;
+    unsigned int count;	/* worker threads - the threads waiting for tasks work too */
+    pthread_mutex_t lock;
+    pthread_cond_t work;	/* a task was queued, or the pool is stopping */
+    pthread_cond_t done;	/* a task has finished */
+    TpTask *head;
+    TpTask *tail;
+    unsigned int users;	/* the pool is stopped and freed when the last user lets go, protected by the lock */
+    bool stop;
+} TPool;
+
+/*
+ * start a pool for given number of threads including the caller (0 = one per online CPU). Workers that fail to start are
+ * done without: with none (count == 0), tasks run in tpWait() on the waiting thread
+ */
+TPool*		tpCreate(const unsigned int threads);
+/* take one more user of the pool, returns the pool */
+TPool*		tpShare(TPool *pool);
+/* let go of the pool: once the last user does this, the workers stop when the queue is empty and the pool is freed */
+void		tpFree(TPool *pool);
+/* queue a task running run(arg) */
+void		tpSubmit(TPool *pool, TpTask *task, void (*run) (void *arg), void *arg);
+/* wait for a task to finish, running queued tasks meanwhile */
+void		tpWait(TPool *pool, TpTask *task);
+
+#endif /* TP_H_ */